@@ -0,0 +1,177 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+#include "minijson2.hpp"
+
+namespace minijson2 {
+
+// A coroutine interface for StreamParser, so that a single thread can parse many documents that
+// arrive in pieces (e.g. request bodies on many connections) without a thread or a buffer for the
+// whole document per connection:
+//     Task<bool> handle_request(AsyncParser& parser)
+//     {
+//         auto token = co_await parser.next();
+//         while (token) {
+//             ...
+//             token = co_await parser.next();
+//         }
+//         co_return token.type() == Token::Type::Eof;
+//     }
+// Instead of returning NeedInput, next() suspends the coroutine, which is then resumed from within
+// the feed() or finish() call that completes the next token. Like with StreamParser, feed()
+// invalidates all tokens and strings returned before, so they must not be kept across a co_await.
+class AsyncParser {
+public:
+    class NextAwaiter {
+    public:
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> handle);
+        Token await_resume() const { return token_; }
+
+    private:
+        friend class AsyncParser;
+
+        explicit NextAwaiter(AsyncParser& parser) : parser_(parser) { }
+
+        AsyncParser& parser_;
+        std::coroutine_handle<> handle_;
+        Token token_;
+    };
+
+    // See StreamParser
+    AsyncParser(bool multiple_documents = false, ParseOptions options = {});
+
+    // Only one coroutine may wait in next() at a time
+    NextAwaiter next();
+
+    // Both resume the waiting coroutine, if there is a complete token now. The coroutine runs until
+    // it waits for input again (or is done) before these return.
+    void feed(std::span<const char> chunk);
+    void finish();
+
+    // Whether a coroutine is suspended in next()
+    bool waiting() const;
+
+    const StreamParser& stream() const;
+
+    std::string_view parse_string(const Token& token, bool escape_in_place = true);
+    int64_t parse_int(const Token& token);
+    uint64_t parse_uint(const Token& token);
+    double parse_float(const Token& token);
+    bool parse_bool(const Token& token);
+
+private:
+    void resume();
+
+    StreamParser stream_;
+    // Points into the frame of the suspended coroutine
+    NextAwaiter* waiting_ = nullptr;
+};
+
+namespace async_detail {
+    // Continues with the coroutine that awaits the finished task, if there is one
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            if (const auto continuation = handle.promise().continuation) {
+                return continuation;
+            }
+            return std::noop_coroutine();
+        }
+
+        void await_resume() noexcept { }
+    };
+
+    struct PromiseBase {
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        // minijson2 does not use exceptions
+        void unhandled_exception() { std::terminate(); }
+
+        std::coroutine_handle<> continuation;
+    };
+
+    template <typename T>
+    struct Promise : PromiseBase {
+        void return_value(T value) { result = std::move(value); }
+
+        std::optional<T> result;
+    };
+
+    template <>
+    struct Promise<void> : PromiseBase {
+        void return_void() { }
+    };
+}
+
+// The return type for coroutines that use AsyncParser. The coroutine starts right away and runs
+// until it waits for input for the first time. A task can also co_await another task (e.g. one that
+// parses a nested value), which resumes it once the other task is done.
+// A task must not be destroyed while it is suspended in AsyncParser::next().
+template <typename T = void>
+class Task {
+public:
+    struct promise_type : async_detail::Promise<T> {
+        Task get_return_object()
+        {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+    };
+
+    Task(Task&& other) : handle_(std::exchange(other.handle_, nullptr)) { }
+
+    Task& operator=(Task&& other)
+    {
+        if (this != &other) {
+            if (handle_) {
+                handle_.destroy();
+            }
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+
+    ~Task()
+    {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    bool done() const { return handle_.done(); }
+
+    // Only if done()
+    T& result()
+        requires(!std::is_void_v<T>)
+    {
+        return *handle_.promise().result;
+    }
+
+    bool await_ready() const { return handle_.done(); }
+    void await_suspend(std::coroutine_handle<> continuation)
+    {
+        handle_.promise().continuation = continuation;
+    }
+    T await_resume()
+    {
+        if constexpr (!std::is_void_v<T>) {
+            return std::move(*handle_.promise().result);
+        }
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) { }
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+}
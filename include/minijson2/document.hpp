@@ -0,0 +1,236 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "minijson2.hpp"
+
+namespace minijson2 {
+
+// A DOM stored as a flat array of nodes in document order (pre-order). Arrays and objects are
+// followed by their children and know the index one past their last descendant, so siblings can be
+// skipped in O(1). Object members are stored as a String node for the key followed by the value.
+// Strings are not copied, but point into the (escaped in-place) input of the parser, so the input
+// has to outlive the document. Only strings that a read-only parser had to escape are copied into
+// the document.
+// A Document can (and should) be reused for multiple parses, which will not allocate anymore once
+// the node array is large enough.
+// Parsed documents can also be saved in a compact binary form, which can later be loaded (from a
+// MappedFile for example) without parsing again.
+class Document {
+public:
+    struct Node {
+        Token::Type type;
+        // For strings that are stored in the document instead of the input
+        bool owned = false;
+        // For strings the length, for arrays the number of elements and for objects the number of
+        // members.
+        uint32_t size = 0;
+        union {
+            bool boolean;
+            uint64_t uint;
+            int64_t int_;
+            double float_;
+            // For strings, relative to the start of the input (or the owned strings)
+            uint64_t offset;
+            // Arrays and objects: Index one past the last descendant
+            uint64_t end;
+        };
+    };
+    static_assert(sizeof(Node) == 16);
+
+    class Value;
+    class ArrayIterator;
+    class ObjectIterator;
+
+    template <typename Iterator>
+    struct Range {
+        Iterator first;
+        Iterator last;
+
+        Iterator begin() const { return first; }
+        Iterator end() const { return last; }
+    };
+
+    struct Member;
+
+    Document() = default;
+
+    // Parses a single value from the parser (usually the whole document). Returns false if there
+    // was an error, which can be retrieved with error().
+    bool parse(Parser& parser);
+
+    // Like parse with Parser(input, scratch, options), but also remembers where in the input each
+    // node is, so that the document can be updated with reparse() after the input has been edited.
+    // The parser is read-only, because the strings of the untouched nodes have to stay valid in the
+    // edited input.
+    bool parse_editable(std::string_view input, std::string& scratch, ParseOptions options = {});
+
+    // Updates the document after old_size bytes at edit_begin of the previous input were replaced,
+    // with input being the whole edited input (the previous one is not needed anymore). Only the
+    // innermost array or object around the edit is parsed again and spliced into the nodes. If the
+    // edit touches its brackets or if it does not end at the same place anymore, the whole input
+    // is parsed like parse_editable() (which is also done for documents that did not come from
+    // it). Strings that had to be copied for replaced nodes are dropped once they make up more than
+    // half of all copied strings (and more bytes than there are nodes).
+    bool reparse(std::string_view input, size_t edit_begin, size_t old_size, std::string& scratch,
+        ParseOptions options = {});
+
+    // Writes the nodes and the strings they reference (each distinct string only once) into out,
+    // which is replaced, but keeps its memory. This is a cache, not an exchange format: The
+    // header has a version, but the nodes are stored with the byte order and layout of this
+    // platform. Only valid after a successful parse (or load).
+    void serialize(std::string& out) const;
+
+    // serialize() into a file. Returns false if it could not be written.
+    bool save(const char* path) const;
+
+    // Uses data from serialize() directly, without copying anything, so it has to outlive the
+    // document and be aligned to 8 bytes (a MappedFile for example). Only the header and the root
+    // node are checked, so the data has to be trusted otherwise. Returns false if it is not a
+    // compatible serialized document, with the reason in error().
+    bool load(std::string_view data);
+
+    // Invalidates all values, but keeps the memory around
+    void clear();
+
+    // Only valid after a successful parse
+    Value root() const;
+
+    const Token& error() const;
+
+    size_t num_nodes() const;
+    const Node& node(size_t index) const;
+
+private:
+    friend class Value;
+
+    // Where a node is in the input, only kept by parse_editable
+    struct Source {
+        uint64_t begin;
+        // One past the closing bracket, only for arrays and objects
+        uint64_t end;
+        // Index of the array or object that contains the node
+        uint32_t parent;
+    };
+    static constexpr uint32_t no_parent = std::numeric_limits<uint32_t>::max();
+
+    template <bool track_sources>
+    bool parse_nodes(
+        Parser& parser, size_t base, std::vector<Node>& nodes, std::vector<Source>& sources);
+    std::optional<size_t> find_enclosing_container(size_t edit_begin, size_t edit_end) const;
+    // Replaces the container at index with the spliced nodes
+    void splice(size_t index, int64_t shift);
+    // Drops the copied strings that are not referenced by any node anymore
+    void compact_owned_strings();
+
+    // The nodes of the last parse or the loaded ones
+    std::span<const Node> nodes() const;
+
+    std::vector<Node> nodes_;
+    // Set by load(), instead of nodes_
+    std::span<const Node> loaded_nodes_;
+    // Parallel to nodes_, if the document is editable
+    std::vector<Source> sources_;
+    // The nodes of the container that is parsed again by reparse()
+    std::vector<Node> spliced_nodes_;
+    std::vector<Source> spliced_sources_;
+    // The currently open arrays and objects during parsing
+    std::vector<uint32_t> stack_;
+    std::string_view strings_;
+    std::string owned_strings_;
+    // Bytes of owned_strings_ that belonged to nodes replaced by reparse()
+    size_t unused_owned_bytes_ = 0;
+    // Reused by compact_owned_strings()
+    std::string compacted_strings_;
+    Token error_;
+};
+
+class Document::Value {
+public:
+    Value(const Document* document, size_t index);
+
+    Token::Type type() const;
+
+    bool is_null() const;
+    bool is_bool() const;
+    // Int, UInt or Float
+    bool is_number() const;
+    bool is_string() const;
+    bool is_array() const;
+    bool is_object() const;
+
+    bool as_bool() const;
+    // Only for UInt
+    uint64_t as_uint() const;
+    // For UInt and Int. UInts that don't fit are not allowed.
+    int64_t as_int() const;
+    // All numbers are converted (with "-0" as -0.0, like Parser::parse_float)
+    double as_double() const;
+    std::string_view as_string() const;
+
+    // Number of elements for arrays, number of members for objects and 0 for everything else
+    size_t size() const;
+
+    // For arrays. This has to skip the elements in front of it, so it is O(index).
+    Value operator[](size_t index) const;
+
+    // For objects. Linear search over all members.
+    std::optional<Value> find(std::string_view key) const;
+
+    Range<ArrayIterator> elements() const;
+    Range<ObjectIterator> members() const;
+
+    size_t index() const { return index_; }
+
+private:
+    friend class ArrayIterator;
+    friend class ObjectIterator;
+
+    const Node& node() const;
+    // Index of the next sibling
+    size_t next() const;
+
+    const Document* document_;
+    size_t index_;
+};
+
+struct Document::Member {
+    std::string_view key;
+    Value value;
+};
+
+class Document::ArrayIterator {
+public:
+    ArrayIterator(const Document* document, size_t index);
+
+    Value operator*() const;
+    ArrayIterator& operator++();
+    bool operator==(const ArrayIterator& other) const = default;
+
+private:
+    const Document* document_;
+    size_t index_;
+};
+
+class Document::ObjectIterator {
+public:
+    // index is the index of the key
+    ObjectIterator(const Document* document, size_t index);
+
+    Member operator*() const;
+    ObjectIterator& operator++();
+    bool operator==(const ObjectIterator& other) const = default;
+
+private:
+    const Document* document_;
+    size_t index_;
+};
+
+}
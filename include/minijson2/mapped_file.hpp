@@ -0,0 +1,37 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace minijson2 {
+
+// A read-only memory mapping of a whole file, to be used with the read-only Parser constructor.
+// Multiple parsers can share the same mapping. On platforms without mmap the file is read into
+// memory instead.
+class MappedFile {
+public:
+    // Returns std::nullopt if the file could not be opened or mapped
+    static std::optional<MappedFile> open(const char* path);
+
+    MappedFile(MappedFile&& other);
+    MappedFile& operator=(MappedFile&& other);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile();
+
+    std::string_view data() const;
+
+private:
+    MappedFile() = default;
+
+    void unmap();
+
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    // The fallback without mmap
+    std::string buffer_;
+};
+
+}
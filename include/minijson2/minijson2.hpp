@@ -1,14 +1,20 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <bitset>
 #include <cassert>
 #include <concepts>
-#include <functional>
 #include <limits>
+#include <memory>
+#include <memory_resource>
 #include <optional>
+#include <span>
 #include <string>
 #include <string_view>
 #include <tuple>
-#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace minijson2 {
@@ -24,8 +30,28 @@ struct Context {
     std::string_view line;
 };
 
+// Scans str up to cursor, so it is meant for the occasional error message
 Context get_context(std::string_view str, size_t cursor);
 
+// The starts of all lines of an input, for when there are many locations to look up in the same
+// large input (e.g. an error for every bad record of a batch). Building it is a single scan for
+// newlines and every lookup is a binary search, while every get_context(str, cursor) scans from the
+// start of the input again. Construct it when the first error is reported, so inputs without errors
+// pay nothing. str has to outlive the index.
+class LineIndex {
+public:
+    explicit LineIndex(std::string_view str);
+
+    // Same as get_context(str, cursor)
+    Context get_context(size_t cursor) const;
+
+    size_t num_lines() const;
+
+private:
+    std::string_view str_;
+    std::vector<size_t> line_starts_;
+};
+
 struct Token {
     // End on eof or if array/object ends
     enum class Type : uint8_t {
@@ -41,6 +67,8 @@ struct Token {
         EndArray,
         EndObject,
         Eof,
+        // Only returned by StreamParser if the next token is not completely buffered yet
+        NeedInput,
         Error,
     };
 
@@ -51,6 +79,9 @@ struct Token {
     // Regular token
     Token(Type type, std::string_view str);
 
+    // String token, of which the parser knows whether it contains escape sequences
+    Token(std::string_view str, bool has_escapes);
+
     // Error token
     Token(size_t cursor, const char* message);
 
@@ -63,7 +94,11 @@ struct Token {
     size_t error_location() const;
     std::string_view error_message() const;
 
-    // Whether to proceed iteration (type is not EndArray, EndObject, Eof or Error)
+    // Only for string tokens. False if the string can be used as is, without escaping it.
+    // Tokens that were not made by a parser conservatively always return true.
+    bool has_escapes() const;
+
+    // Whether to proceed iteration (type is not EndArray, EndObject, Eof, NeedInput or Error)
     explicit operator bool() const;
 
 private:
@@ -75,15 +110,80 @@ private:
     // type), but the bitmasking and stuff is too annoying and too complicated for a simple library
     // like this. Somehow I measured that bitmasking to be slightly faster than the current method,
     // but that makes no sense to me.
+    // has_escapes_ fits into the padding after type_.
     const char* str_ = 0;
     uint32_t length_ = 0;
     Type type_;
+    bool has_escapes_ = true;
+};
+
+enum class ParseMode : uint8_t {
+    // Scan the input as the tokens are requested
+    Default,
+    // Build an index of all structural characters and strings of the whole input up front (like
+    // stage 1 of simdjson) and jump through it in next(). This costs an allocation of about one
+    // uint32_t per token and only works for inputs smaller than 1GB (larger inputs fall back to
+    // Default), but skipping whitespace and most strings becomes trivial.
+    Indexed,
+};
+
+enum class SkipMode : uint8_t {
+    // Jump to the end of an array or object by only looking at brackets and string boundaries.
+    // Whatever is inside is not validated, only the brackets have to be balanced.
+    Fast,
+    // Tokenize everything with next(), so errors inside the skipped value are found as well
+    Strict,
+};
+
+struct ParseOptions {
+    ParseMode mode = ParseMode::Default;
+    // Used by skip() and therefore for ignored keys in structread
+    SkipMode skip_mode = SkipMode::Fast;
+    // Reject strings (including keys) that are not valid UTF-8. This is done in the same scan that
+    // looks for the end of the string, so ASCII text costs almost nothing extra. Values that are
+    // jumped over by SkipMode::Fast are not validated.
+    bool validate_utf8 = false;
+};
+
+// Only collected if minijson2 is built with MINIJSON2_STATS (the CMake option of the same name),
+// otherwise all counters stay zero and collecting them costs nothing.
+struct ParseStats {
+    static constexpr size_t num_token_types = static_cast<size_t>(Token::Type::Error) + 1;
+
+    // Returned by next(), indexed by Token::Type
+    std::array<size_t, num_token_types> tokens {};
+    // Input bytes of all strings that were passed through escape_string
+    size_t escaped_bytes = 0;
+    // Input bytes of all values passed to skip()
+    size_t skipped_bytes = 0;
+    // Of nested arrays and objects
+    size_t max_depth = 0;
+    // Made by the parser itself (container stack, structural index, scratch buffer) and for
+    // structread error messages (one per error). Allocations for the values that are parsed into
+    // are not counted.
+    size_t allocations = 0;
+
+    size_t num_tokens(Token::Type type) const { return tokens[static_cast<size_t>(type)]; }
 };
 
 class Parser {
 public:
     // Mutable reference to escape strings in-place
-    Parser(std::string& input);
+    Parser(std::string& input, ParseOptions options = {});
+    // Same, but for a part of a larger buffer
+    Parser(std::span<char> input, ParseOptions options = {});
+
+    // Read-only input (e.g. a MappedFile). parse_string will return views into the input for
+    // strings without escape sequences and only escape the others into scratch. The latter are only
+    // valid until the next call to parse_string.
+    Parser(std::string_view input, std::string& scratch, ParseOptions options = {});
+
+    // Start over with new input and the same options, like a new parser, but keep the memory
+    // (the overflow of the container stack and the structural index). Parsers that are used for
+    // many small documents (e.g. lines of NDJSON) should be reset instead of constructed again.
+    void reset(std::string& input);
+    void reset(std::span<char> input);
+    void reset(std::string_view input, std::string& scratch);
 
     Parser(Parser&&) = default;
     Parser& operator=(Parser&&) = default;
@@ -93,11 +193,25 @@ public:
     std::string_view input() const;
     size_t get_location(const Token& token) const;
 
+    // All zero without MINIJSON2_STATS
+    const ParseStats& stats() const;
+
     Token next();
+    // Skips the value starting with token (e.g. a whole array, if token is Array) according to
+    // ParseOptions::skip_mode. Returns false on error, which next() will return afterwards.
+    // For Array and Object this also works if some of the elements have been read already.
     bool skip(const Token& token);
 
+    // For inputs that are a batch of documents one after the other (e.g. `{"id":1}{"id":2}`, with
+    // or without whitespace in between), which would otherwise need a parser per document: next()
+    // returns Eof at the end of every document and next_document() continues with the next one.
+    // Returns false if there is nothing but whitespace left (or the document is not complete).
+    // It can also be called before the first document, so a batch without any is not an error:
+    //     while (parser.next_document()) { /* read one value, until Eof */ }
+    bool next_document();
+
     // Don't call this function twice for the same token, as it might escape the same string twice
-    // (which would be wrong).
+    // (which would be wrong). This does not apply to read-only parsers.
     // Also keep in mind that the Token string_view will not be correct afterwards.
     std::string_view parse_string(const Token& token, bool escape_in_place = true);
     int64_t parse_int(const Token& token);
@@ -106,30 +220,135 @@ public:
     bool parse_bool(const Token& token);
 
 private:
-    enum class ExpectNext : uint8_t {
-        Error,
+    // What next() expects to come next
+    enum class State : uint8_t {
+        // A single value (the document or an array element after a comma)
         Value,
-        ObjectKey,
+        // After '[': A value or ']'
+        ArrayStart,
+        // After an array element: ',' or ']'
+        ArrayNext,
+        // After '{': A key or '}'
+        ObjectStart,
+        // After a key: ':' and a value
         ObjectValue,
-        ArrayValue,
+        // After an object member: ',' and a key or '}'
+        ObjectNext,
+        // The document is complete, Eof from now on
+        Done,
+        // Return the error forever
+        Error,
     };
 
+    Token next_token();
+    bool skip_value(const Token& token);
+    bool skip_container_fast(bool object);
     Token on_value();
     Token on_object_key();
     Token on_object_value();
-    Token on_array_value();
+    Token end_container(Token::Type type);
 
+    void init(char* buffer, std::string_view input, std::string* scratch);
+    uint64_t& container_word(size_t word);
+    void push_container(bool object);
     void skip_whitespace();
+    uint32_t next_index_entry();
 
     Token string_token();
-    Token number_token(std::string_view value);
+    Token number_token();
+    Token invalid_number_token(size_t pos);
     Token error_token(const char* message);
+    // For errors that might just be caused by the input being cut off (in partial mode)
+    Token end_of_input_token(const char* message);
+
+    friend class StreamParser;
 
-    std::string& input_buffer_;
+    Parser(char* buffer, std::string_view input, std::string* scratch, ParseOptions options);
+
+    // nullptr for read-only parsers
+    char* buffer_;
+    std::string* scratch_;
     std::string_view input_;
     size_t cursor_ = 0;
-    std::vector<ExpectNext> expect_next_;
+    State state_ = State::Value;
+    // The state after a complete value, which depends on the innermost container, so it does not
+    // have to be looked up on the stack for every value
+    State after_value_ = State::Done;
+    // The open containers as a bit-stack with one bit per level (set for objects) and 64 levels per
+    // word. The first words are stored inline, so documents up to a depth of 128 need no
+    // allocation, and deeper ones continue in overflow_containers_.
+    std::array<uint64_t, 2> containers_ {};
+    std::vector<uint64_t> overflow_containers_;
+    size_t depth_ = 0;
     const char* error_message_ = nullptr;
+    ParseOptions options_;
+    // options_.mode, unless the input is too large to be indexed
+    ParseMode mode_;
+    std::vector<uint32_t> structural_index_;
+    size_t index_pos_ = 0;
+    // If the input might be continued later, errors at the end of the input roll back the parser
+    // to the start of the last token instead.
+    bool partial_ = false;
+    bool need_input_ = false;
+    // The value of the last number token, which is usually the one that is parsed next. str is
+    // nullptr if it has to be parsed from the string.
+    struct {
+        const char* str = nullptr;
+        union {
+            uint64_t uint;
+            int64_t int_;
+            double float_;
+        };
+    } number_cache_;
+#ifdef MINIJSON2_STATS
+    ParseStats stats_;
+#endif
+};
+
+// Parses a document that arrives in chunks, e.g. from a pipe or a socket. Only the part of the
+// input that has not been returned as tokens yet is kept in memory, so memory usage is bounded by
+// the size of the chunks and the largest token, not by the size of the document.
+// If next() returns a NeedInput token, feed() the next chunk and try again. Once there is no more
+// input, call finish(), after which truncated input is reported as an error like in Parser.
+// feed() moves the buffered input, so it invalidates all tokens and strings returned before!
+class StreamParser {
+public:
+    // With multiple_documents, the stream may contain any number of whitespace-separated values
+    // (like NDJSON) and Eof is only returned at the end of the stream. options.mode is ignored,
+    // because the input is never complete enough to be indexed.
+    StreamParser(bool multiple_documents = false, ParseOptions options = {});
+
+    // The parser points into buffer_
+    StreamParser(StreamParser&&) = delete;
+    StreamParser& operator=(StreamParser&&) = delete;
+    StreamParser(const StreamParser&) = delete;
+    StreamParser& operator=(const StreamParser&) = delete;
+
+    void feed(std::span<const char> chunk);
+    void finish();
+
+    // Like Parser::next, but may return NeedInput before finish() was called
+    Token next();
+
+    // Absolute location in the stream, error locations are absolute too
+    size_t get_location(const Token& token) const;
+    // The currently buffered input, which starts at absolute location consumed()
+    std::string_view buffered() const;
+    size_t consumed() const;
+    const ParseStats& stats() const;
+
+    std::string_view parse_string(const Token& token, bool escape_in_place = true);
+    int64_t parse_int(const Token& token);
+    uint64_t parse_uint(const Token& token);
+    double parse_float(const Token& token);
+    bool parse_bool(const Token& token);
+
+private:
+    std::string buffer_;
+    Parser parser_;
+    size_t consumed_ = 0;
+    bool multiple_documents_;
+    bool finished_ = false;
 };
 
 namespace structread {
@@ -144,8 +363,22 @@ namespace structread {
         {
         }
 
+        // Parser::reset, which also clears the error
+        template <typename... Args>
+        void reset(Args&&... args)
+        {
+            parser.reset(std::forward<Args>(args)...);
+            error.reset();
+#ifdef MINIJSON2_STATS
+            error_allocations = 0;
+#endif
+        }
+
         bool set_error(size_t location, std::string message)
         {
+#ifdef MINIJSON2_STATS
+            error_allocations++;
+#endif
             error = { location, std::move(message) };
             return false;
         }
@@ -162,8 +395,45 @@ namespace structread {
                 error_token.error_location(), std::string(error_token.error_message()));
         }
 
+        // The parser's stats, including the allocations for error messages
+        ParseStats stats() const
+        {
+            auto stats = parser.stats();
+#ifdef MINIJSON2_STATS
+            stats.allocations += error_allocations;
+#endif
+            return stats;
+        }
+
         Parser parser;
         std::optional<Error> error;
+        // If set, std::pmr strings and vectors are moved to this resource (e.g. a
+        // std::pmr::monotonic_buffer_resource per request) before they are filled. It also holds
+        // the escaped strings of std::string_view fields, if the parser is read-only.
+        // Otherwise pmr containers keep the resource they were constructed with.
+        std::pmr::memory_resource* memory_resource = nullptr;
+#ifdef MINIJSON2_STATS
+        size_t error_allocations = 0;
+#endif
+    };
+
+    // The path to a value in the document for error messages, e.g. ".scenes[0].nodes". It is a
+    // linked list of path elements on the stack, so building it is free and it is only turned into
+    // a string if there actually is an error.
+    class Path {
+    public:
+        // Root
+        Path() = default;
+        Path(const Path& parent, std::string_view key) : parent_(&parent), key_(key) { }
+        Path(const Path& parent, size_t index) : parent_(&parent), index_(index) { }
+
+        std::string string() const;
+
+    private:
+        const Path* parent_ = nullptr;
+        // If key_.data() is nullptr, index_ is used
+        std::string_view key_;
+        size_t index_ = 0;
     };
 
     template <typename... Args>
@@ -176,7 +446,7 @@ namespace structread {
     }
 
     template <typename T>
-    bool from_json(T& val, ParseContext& ctx, const Token& token, const std::string& path)
+    bool from_json(T& val, ParseContext& ctx, const Token& token, const Path& path)
     {
         if (ctx.error) {
             return false;
@@ -191,16 +461,43 @@ namespace structread {
     bool from_json(T& val, ParseContext& ctx)
     {
         const auto token = ctx.parser.next();
-        return from_json(val, ctx, token, "");
+        return from_json(val, ctx, token, Path());
     }
 
-    bool check_type(ParseContext& ctx, const Token& token, const std::string& path,
+    bool check_type(ParseContext& ctx, const Token& token, const Path& path,
         Token::Type type, std::string_view type_name);
 
-    bool from_json_impl(bool& v, ParseContext& ctx, const Token& token, const std::string& path);
+    bool from_json_impl(bool& v, ParseContext& ctx, const Token& token, const Path& path);
 
     bool from_json_impl(
-        std::string& str, ParseContext& ctx, const Token& token, const std::string& path);
+        std::string& str, ParseContext& ctx, const Token& token, const Path& path);
+
+    bool from_json_impl(
+        std::pmr::string& str, ParseContext& ctx, const Token& token, const Path& path);
+
+    // Zero-copy: The view points into the input (which is escaped in place), so the input has to
+    // outlive it. Read-only parsers escape into their scratch buffer instead, which is reused for
+    // the next string, so in that case escaped strings are copied to ctx.memory_resource and
+    // without one they are an error.
+    bool from_json_impl(
+        std::string_view& str, ParseContext& ctx, const Token& token, const Path& path);
+
+    // Polymorphic allocators do not propagate on assignment, so a pmr container has to be
+    // constructed again to use ctx.memory_resource. Its elements are moved along.
+    template <typename Container>
+    void use_memory_resource(Container& container, ParseContext& ctx)
+    {
+        using Allocator = typename Container::allocator_type;
+        using PmrAllocator = std::pmr::polymorphic_allocator<typename Container::value_type>;
+        if constexpr (std::is_same_v<Allocator, PmrAllocator>) {
+            const auto resource = container.get_allocator().resource();
+            if (ctx.memory_resource && resource != ctx.memory_resource) {
+                Container moved(std::move(container), Allocator(ctx.memory_resource));
+                std::destroy_at(&container);
+                std::construct_at(&container, std::move(moved));
+            }
+        }
+    }
 
     template <std::integral Target, std::integral Source>
     constexpr bool can_convert(Source val)
@@ -233,15 +530,16 @@ namespace structread {
     concept non_bool_int = std::integral<T> && !std::is_same_v<T, bool>;
 
     template <non_bool_int T>
-    bool from_json_impl(T& v, ParseContext& ctx, const Token& token, const std::string& path)
+    bool from_json_impl(T& v, ParseContext& ctx, const Token& token, const Path& path)
     {
         if constexpr (std::is_signed_v<T>) {
             if (token.type() != Token::Type::Int && token.type() != Token::Type::UInt) {
-                return ctx.set_error(token, concat_string(path, " must be integer"));
+                return ctx.set_error(token, concat_string(path.string(), " must be integer"));
             };
         } else {
             if (token.type() != Token::Type::UInt) {
-                return ctx.set_error(token, concat_string(path, " must be unsigned integer"));
+                return ctx.set_error(
+                    token, concat_string(path.string(), " must be unsigned integer"));
             };
         }
 
@@ -249,19 +547,19 @@ namespace structread {
         if (!can_convert<T>(raw_val)) {
             const auto min = std::to_string(std::numeric_limits<T>::min());
             const auto max = std::to_string(std::numeric_limits<T>::max());
-            return ctx.set_error(
-                token, concat_string(path, " must be integer in range [", min, ", ", max, "]"));
+            return ctx.set_error(token,
+                concat_string(path.string(), " must be integer in range [", min, ", ", max, "]"));
         }
         v = static_cast<T>(raw_val);
         return true;
     }
 
     template <std::floating_point T>
-    bool from_json_impl(T& v, ParseContext& ctx, const Token& token, const std::string& path)
+    bool from_json_impl(T& v, ParseContext& ctx, const Token& token, const Path& path)
     {
         if (token.type() != Token::Type::Int && token.type() != Token::Type::UInt
             && token.type() != Token::Type::Float) {
-            return ctx.set_error(token, concat_string(path, " must be a number"));
+            return ctx.set_error(token, concat_string(path.string(), " must be a number"));
         };
         v = static_cast<T>(ctx.parser.parse_float(token));
         return true;
@@ -269,23 +567,25 @@ namespace structread {
 
     template <typename T>
     bool from_json_impl(
-        std::optional<T>& opt, ParseContext& ctx, const Token& token, const std::string& path)
+        std::optional<T>& opt, ParseContext& ctx, const Token& token, const Path& path)
     {
         return from_json(opt.emplace(), ctx, token, path);
     }
 
-    template <typename T>
+    // Elements of std::pmr::vector get the vector's resource by uses-allocator construction (e.g.
+    // std::pmr::string elements)
+    template <typename T, typename Allocator>
     bool from_json_impl(
-        std::vector<T>& vec, ParseContext& ctx, const Token& token, const std::string& path)
+        std::vector<T, Allocator>& vec, ParseContext& ctx, const Token& token, const Path& path)
     {
         if (!check_type(ctx, token, path, Token::Type::Array, "array")) {
             return false;
         }
+        use_memory_resource(vec, ctx);
         size_t i = 0;
         auto elem = ctx.parser.next();
         while (elem) {
-            const auto val_path = concat_string(path, "[", std::to_string(i), "]");
-            if (!from_json(vec.emplace_back(), ctx, elem, val_path)) {
+            if (!from_json(vec.emplace_back(), ctx, elem, Path(path, i))) {
                 return false;
             }
             i++;
@@ -297,27 +597,72 @@ namespace structread {
         return true;
     }
 
-    template <typename T, size_t N>
+    template <typename T>
+    concept number = non_bool_int<T> || std::floating_point<T>;
+
+    // Returns the number of elements of the array starting at array_start (the location of the
+    // '['), if it can be counted cheaply, i.e. if it does not contain strings or containers.
+    // Otherwise it returns 0. This is only a hint and does not validate the array.
+    size_t count_scalar_array_elements(std::string_view input, size_t array_start);
+
+    // Arrays of numbers are common and large (e.g. vertex data), so they get their own loop, which
+    // reserves the required memory up front and converts the elements directly.
+    template <number T, typename Allocator>
     bool from_json_impl(
-        std::array<T, N>& arr, ParseContext& ctx, const Token& token, const std::string& path)
+        std::vector<T, Allocator>& vec, ParseContext& ctx, const Token& token, const Path& path)
     {
-        const std::string type_name = "array of size " + std::to_string(N);
-        if (!check_type(ctx, token, path, Token::Type::Array, type_name)) {
+        if (!check_type(ctx, token, path, Token::Type::Array, "array")) {
             return false;
         }
+        use_memory_resource(vec, ctx);
+        const auto hint
+            = count_scalar_array_elements(ctx.parser.input(), ctx.parser.get_location(token));
+        if (vec.capacity() - vec.size() < hint) {
+            // Don't defeat the geometric growth if this is called repeatedly on the same vector
+            vec.reserve(std::max(vec.size() + hint, vec.capacity() * 2));
+        }
+        size_t i = 0;
+        auto elem = ctx.parser.next();
+        while (elem) {
+            // Like in from_json_fixed_array, from_json would only check again
+            if (!from_json_impl(vec.emplace_back(), ctx, elem, Path(path, i))) {
+                return false;
+            }
+            i++;
+            elem = ctx.parser.next();
+        }
+        if (elem.type() == Token::Type::Error) {
+            return ctx.set_error(elem);
+        }
+        return true;
+    }
+
+    // Parses an array of exactly out.size() elements into out
+    template <typename T>
+    bool from_json_fixed_array(
+        std::span<T> out, ParseContext& ctx, const Token& token, const Path& path)
+    {
+        const auto type_error = [&](size_t location) {
+            return ctx.set_error(location,
+                concat_string(
+                    path.string(), " must be array of size ", std::to_string(out.size())));
+        };
+        if (token.type() != Token::Type::Array) {
+            return type_error(ctx.parser.get_location(token));
+        }
         const auto array_start = ctx.parser.get_location(token);
         size_t i = 0;
         auto elem = ctx.parser.next();
-        while (elem && i < N) {
-            const auto val_path = concat_string(path, "[", std::to_string(i), "]");
-            if (!from_json(arr[i], ctx, elem, val_path)) {
+        while (elem && i < out.size()) {
+            // elem is not an error and ctx.error is not set, so from_json would only check again
+            if (!from_json_impl(out[i], ctx, elem, Path(path, i))) {
                 return false;
             }
             i++;
             elem = ctx.parser.next();
         }
-        if (i != N) {
-            return ctx.set_error(array_start, path + "must be " + type_name);
+        if (i != out.size()) {
+            return type_error(array_start);
         }
         if (elem.type() == Token::Type::Error) {
             return ctx.set_error(elem);
@@ -325,6 +670,21 @@ namespace structread {
         return true;
     }
 
+    template <typename T, size_t N>
+    bool from_json_impl(
+        std::array<T, N>& arr, ParseContext& ctx, const Token& token, const Path& path)
+    {
+        return from_json_fixed_array(std::span<T>(arr), ctx, token, path);
+    }
+
+    // A caller-provided buffer. The array has to have exactly as many elements as the span.
+    template <typename T>
+    bool from_json_impl(
+        std::span<T>& span, ParseContext& ctx, const Token& token, const Path& path)
+    {
+        return from_json_fixed_array(span, ctx, token, path);
+    }
+
     template <typename T>
     struct type_meta;
 
@@ -337,7 +697,9 @@ namespace structread {
     template <typename... Args>
     constexpr auto make_fields(Args&&... args)
     {
-        return std::tuple(std::forward<Args>(args)...);
+        // Not std::tuple(args...), because for a single field that would copy the field tuple
+        // instead of wrapping it
+        return std::make_tuple(std::forward<Args>(args)...);
     }
 
     template <typename T>
@@ -399,82 +761,224 @@ namespace structread {
     template <typename T>
     struct key_handler_ignore {
         bool operator()(
-            std::string_view, T&, ParseContext& ctx, const Token& token, const std::string&)
+            std::string_view, T&, ParseContext& ctx, const Token& token, const Path&)
         {
-            return ctx.parser.skip(token);
+            if (!ctx.parser.skip(token)) {
+                return ctx.set_error(ctx.parser.next());
+            }
+            return true;
         };
     };
 
+    // Calls the key handler for key_name with the value after the key, if there is one. Returns
+    // whether there was one and its result in ok. The handlers are matched in a fold over
+    // key_handlers<T>::handlers, so types without handlers pay nothing and handlers can be inlined.
     template <typename T>
-    auto get_key_handler(std::string_view key_name)
+    bool call_key_handler(
+        std::string_view key_name, T& obj, ParseContext& ctx, const Path& path, bool& ok)
     {
-        std::function<bool(std::string_view key, T & obj, ParseContext & ctx, const Token& token,
-            const std::string& path)>
-            handler;
-        auto apply_handler = [key_name, &handler](auto& key_handler) -> bool {
-            const auto name = std::get<0>(key_handler);
-            auto& func = std::get<1>(key_handler);
-            if (key_name == name) {
-                handler = func;
-                return true;
+        auto apply_handler = [&](const auto& key_handler) -> bool {
+            if (std::get<0>(key_handler) != key_name) {
+                return false;
             }
-            return false;
+            // handlers is constexpr, but the handlers do not have to be const-callable
+            auto func = std::get<1>(key_handler);
+            ok = func(key_name, obj, ctx, ctx.parser.next(), path);
+            return true;
         };
-
-        std::apply([&](auto&&... handlers) { return (apply_handler(handlers) || ...); },
+        return std::apply([&](const auto&... handlers) { return (apply_handler(handlers) || ...); },
             key_handlers<T>::handlers);
-        return handler;
     }
 
-    template <has_type_meta T>
-    bool from_json_impl(T& obj, ParseContext& ctx, const Token& token, const std::string& path)
+    template <typename T>
+    constexpr size_t num_fields = std::tuple_size_v<std::remove_cvref_t<type_meta_fields_type<T>>>;
+
+    template <typename T>
+    constexpr auto field_names = std::apply(
+        [](const auto&... fields) {
+            return std::array<std::string_view, sizeof...(fields)> { std::get<0>(fields)... };
+        },
+        get_type_meta<T>::fields);
+
+    template <typename T>
+    constexpr auto required_fields = std::apply(
+        [](const auto&... fields) {
+            return std::array<bool, sizeof...(fields)> { !is_optional<T,
+                decltype(std::declval<T&>().*std::get<1>(fields))>(std::get<0>(fields))... };
+        },
+        get_type_meta<T>::fields);
+
+    // Only looks at the length and up to three characters, so it is O(1). Collisions are very
+    // likely for some inputs, but the probing in FieldTable takes care of that.
+    constexpr uint32_t key_hash(std::string_view key, uint32_t seed)
     {
-        if (!check_type(ctx, token, path, Token::Type::Object, "object")) {
-            return false;
+        auto h = seed ^ (static_cast<uint32_t>(key.size()) * 0x9E37'79B1u);
+        if (!key.empty()) {
+            h ^= static_cast<uint32_t>(static_cast<unsigned char>(key.front())) * 0x85EB'CA77u;
+            h ^= static_cast<uint32_t>(static_cast<unsigned char>(key.back())) * 0xC2B2'AE3Du;
+            h ^= static_cast<uint32_t>(static_cast<unsigned char>(key[key.size() / 2]))
+                * 0x27D4'EB2Fu;
         }
-        const auto obj_location = ctx.parser.get_location(token);
+        h ^= h >> 15;
+        h *= 0x2C1B'3C6Du;
+        h ^= h >> 12;
+        return h;
+    }
+
+    // An open addressing hash table from key names to field indices, that is built at compile time.
+    // It tries to find a seed for key_hash that makes it a perfect hash, so lookups need a single
+    // probe and a single string comparison.
+    template <size_t N>
+    struct FieldTable {
+        static constexpr size_t num_slots = std::bit_ceil(N * 2 + 1);
+        static constexpr uint16_t empty = 0xFFFF;
+        static_assert(N < empty);
 
-        bool known_key = false;
-        std::string_view key_str;
-        // Maybe replace this map with an array in the future (has some complications)
-        std::unordered_map<std::string_view, bool> keys_found;
+        std::array<uint16_t, num_slots> slots;
+        uint32_t seed = 0;
 
-        auto apply_field = [&](auto& field) {
-            const auto field_name = std::get<0>(field);
-            auto& obj_field = obj.*std::get<1>(field);
-            if (!is_optional<T, decltype(obj_field)>(field_name)) {
-                keys_found.emplace(field_name, false);
+        constexpr FieldTable(const std::array<std::string_view, N>& names)
+        {
+            for (uint32_t s = 0; s < 1024; ++s) {
+                if (build(names, s)) {
+                    return;
+                }
             }
-            if (key_str == field_name) {
-                known_key = true;
-                keys_found[field_name] = true;
-                const auto field_path = concat_string(path, ".", field_name);
-                if (!from_json(obj_field, ctx, ctx.parser.next(), field_path)) {
-                    return false;
+            build(names, 0); // Not perfect, but probing works just as well
+        }
+
+        // Returns whether there were no collisions
+        constexpr bool build(const std::array<std::string_view, N>& names, uint32_t s)
+        {
+            seed = s;
+            slots.fill(empty);
+            bool perfect = true;
+            for (size_t i = 0; i < N; ++i) {
+                auto slot = key_hash(names[i], seed) & (num_slots - 1);
+                while (slots[slot] != empty) {
+                    perfect = false;
+                    slot = (slot + 1) & (num_slots - 1);
+                }
+                slots[slot] = static_cast<uint16_t>(i);
+            }
+            return perfect;
+        }
+
+        // Returns N if the key is not found
+        constexpr size_t find(
+            const std::array<std::string_view, N>& names, std::string_view key) const
+        {
+            auto slot = key_hash(key, seed) & (num_slots - 1);
+            while (slots[slot] != empty) {
+                if (names[slots[slot]] == key) {
+                    return slots[slot];
                 }
+                slot = (slot + 1) & (num_slots - 1);
+            }
+            return N;
+        }
+    };
+
+    template <typename T>
+    constexpr FieldTable<num_fields<T>> field_table(field_names<T>);
+
+    template <typename T, size_t I>
+    bool parse_field(T& obj, ParseContext& ctx, const Token& token, const Path& path)
+    {
+        const auto& field = std::get<I>(get_type_meta<T>::fields);
+        return from_json(obj.*std::get<1>(field), ctx, token, Path(path, std::get<0>(field)));
+    }
+
+    template <typename T, size_t... I>
+    constexpr auto make_field_parsers(std::index_sequence<I...>)
+    {
+        using FieldParser = bool (*)(T&, ParseContext&, const Token&, const Path&);
+        return std::array<FieldParser, sizeof...(I)> { &parse_field<T, I>... };
+    }
+
+    // One function per field, so the field index from the FieldTable can be dispatched directly
+    template <typename T>
+    constexpr auto field_parsers = make_field_parsers<T>(std::make_index_sequence<num_fields<T>>());
+
+    // Whether the raw key can be compared with the field name directly. Not if a key handler takes
+    // the key or if the name would have to be escaped (so the key might be too).
+    template <typename T, size_t I>
+    constexpr bool expect_field_in_order = [] {
+        const auto name = field_names<T>[I];
+        const auto has_handler = std::apply(
+            [name](const auto&... handlers) { return ((std::get<0>(handlers) == name) || ...); },
+            key_handlers<T>::handlers);
+        return !has_handler && name.find('\\') == std::string_view::npos;
+    }();
+
+    // Returns false if the key is not field I, so the remaining keys are dispatched as usual, or if
+    // the value could not be parsed (error is set then). Otherwise key is the next key afterwards.
+    template <typename T, size_t I, size_t N>
+    bool parse_field_in_order(T& obj, ParseContext& ctx, Token& key, const Path& path,
+        std::bitset<N>& fields_found, bool& error)
+    {
+        if constexpr (!expect_field_in_order<T, I>) {
+            return false;
+        } else {
+            if (!key || key.string() != field_names<T>[I]) {
+                return false;
+            }
+            fields_found.set(I);
+            if (!parse_field<T, I>(obj, ctx, ctx.parser.next(), path)) {
+                error = true;
+                return false;
             }
+            key = ctx.parser.next();
             return true;
-        };
+        }
+    }
+
+    // Most of our producers write the fields in declaration order, so they are expected in that
+    // order first, which needs a single comparison per key and lets the compiler inline the value
+    // parsers. The first key that does not match ends this. Returns false on error.
+    template <typename T, size_t N, size_t... I>
+    bool parse_fields_in_order(T& obj, ParseContext& ctx, Token& key, const Path& path,
+        std::bitset<N>& fields_found, std::index_sequence<I...>)
+    {
+        bool error = false;
+        (parse_field_in_order<T, I>(obj, ctx, key, path, fields_found, error) && ...);
+        return !error;
+    }
+
+    template <has_type_meta T>
+    bool from_json_impl(T& obj, ParseContext& ctx, const Token& token, const Path& path)
+    {
+        if (!check_type(ctx, token, path, Token::Type::Object, "object")) {
+            return false;
+        }
+        const auto obj_location = ctx.parser.get_location(token);
+
+        constexpr auto N = num_fields<T>;
+        std::bitset<N> fields_found;
 
         auto key = ctx.parser.next();
+        if (!parse_fields_in_order(
+                obj, ctx, key, path, fields_found, std::make_index_sequence<N>())) {
+            return false;
+        }
         while (key) {
-            key_str = ctx.parser.parse_string(key);
-            known_key = false;
+            const auto key_str = ctx.parser.parse_string(key);
 
-            auto handler = get_key_handler<T>(key_str);
-            if (handler) {
-                known_key = true;
-                if (!handler(key_str, obj, ctx, ctx.parser.next(), path)) {
+            bool handler_ok = true;
+            if (call_key_handler(key_str, obj, ctx, path, handler_ok)) {
+                if (!handler_ok) {
+                    return false;
+                }
+            } else {
+                const auto field_index = field_table<T>.find(field_names<T>, key_str);
+                if (field_index == N) {
+                    return ctx.set_error(
+                        key, concat_string(path.string(), ": Unknown key '", key_str, "'"));
+                }
+                fields_found.set(field_index);
+                if (!field_parsers<T>[field_index](obj, ctx, ctx.parser.next(), path)) {
                     return false;
                 }
-            } else if (!std::apply(
-                           [&](auto&... fields_args) { return (apply_field(fields_args) && ...); },
-                           get_type_meta<T>::fields)) {
-                return false;
-            }
-
-            if (!known_key) {
-                return ctx.set_error(key, concat_string(path, ": Unknown key '", key_str, "'"));
             }
 
             key = ctx.parser.next();
@@ -484,14 +988,35 @@ namespace structread {
             return ctx.set_error(key);
         }
 
-        for (const auto& [key, found] : keys_found) {
-            if (!found) {
-                return ctx.set_error(
-                    obj_location, concat_string(path, ": Missing key '", key, "'"));
+        for (size_t i = 0; i < N; ++i) {
+            if (required_fields<T>[i] && !fields_found[i]) {
+                return ctx.set_error(obj_location,
+                    concat_string(path.string(), ": Missing key '", field_names<T>[i], "'"));
             }
         }
         return true;
     }
+
+    // Appends one value per document of a batch (see Parser::next_document) to values, all with the
+    // same parser. With pmr containers and ctx.memory_resource, all documents share one arena too.
+    // Error paths start with the index of the document in the batch, e.g. "[3].name". On error,
+    // values is left as it was.
+    template <typename T, typename Allocator>
+    bool from_json_documents(std::vector<T, Allocator>& values, ParseContext& ctx)
+    {
+        use_memory_resource(values, ctx);
+        const auto first = values.size();
+        const Path root;
+        size_t i = 0;
+        while (ctx.parser.next_document()) {
+            if (!from_json(values.emplace_back(), ctx, ctx.parser.next(), Path(root, i))) {
+                values.resize(first);
+                return false;
+            }
+            i++;
+        }
+        return true;
+    }
 }
 }
 
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "minijson2.hpp"
+
+namespace minijson2 {
+
+struct NdjsonOptions {
+    // 0 means std::thread::hardware_concurrency(). The calling thread is one of them.
+    size_t num_threads = 0;
+    // Lines are handed to the threads in batches of roughly this many bytes
+    size_t batch_size = 64 * 1024;
+    ParseOptions parse_options;
+};
+
+struct NdjsonResult {
+    // Everything up to and including the last newline (or everything with end_of_input). The rest
+    // is a partial line, which should be passed again at the start of the next chunk.
+    size_t consumed = 0;
+    size_t num_lines = 0;
+    // false if a callback returned false
+    bool ok = true;
+};
+
+// Parses newline-delimited JSON (one document per line) on a pool of threads. Every line gets its
+// own Parser, so an error in one line does not affect the others. Newlines inside strings are not
+// considered, because they are not valid in NDJSON anyway.
+class NdjsonParser {
+public:
+    // Called for every line with a parser for that line. line is the index of the line in the
+    // input and thread is in [0, num_threads()), so it can be used to index per-thread state.
+    // Lines are parsed concurrently and in no particular order. Returning false stops parsing, but
+    // lines that are already being parsed on other threads will still be completed.
+    // Every thread resets the same parser for each of its lines (to reuse its memory), so the
+    // callback must not keep it around.
+    using Callback = std::function<bool(Parser& parser, size_t line, size_t thread)>;
+
+    NdjsonParser(NdjsonOptions options = {});
+    ~NdjsonParser();
+
+    NdjsonParser(const NdjsonParser&) = delete;
+    NdjsonParser& operator=(const NdjsonParser&) = delete;
+
+    size_t num_threads() const;
+
+    // The context of the parser that is passed to the callback on thread, e.g. for structread. It
+    // is reset for every line too.
+    structread::ParseContext& context(size_t thread);
+
+    // Strings are escaped in-place, like with Parser. If end_of_input is false, a trailing line
+    // without a newline is not parsed, but left for the next call (see NdjsonResult::consumed).
+    // Empty lines are passed to the callback too (and result in an error token).
+    NdjsonResult parse(std::span<char> input, bool end_of_input, const Callback& callback);
+
+    // The number of lines parse would pass to the callback
+    static size_t count_lines(std::span<const char> input, bool end_of_input);
+
+private:
+    struct Batch {
+        size_t begin;
+        size_t end;
+        size_t first_line;
+    };
+
+    void worker(size_t thread);
+    void run_batches(size_t thread);
+
+    NdjsonOptions options_;
+    // One per thread
+    std::vector<structread::ParseContext> contexts_;
+    std::vector<std::thread> threads_;
+    std::vector<Batch> batches_;
+
+    // The current job
+    std::span<char> input_;
+    const Callback* callback_ = nullptr;
+    std::atomic<size_t> next_batch_ = 0;
+    std::atomic<bool> failed_ = false;
+
+    std::mutex mutex_;
+    std::condition_variable job_cv_;
+    std::condition_variable done_cv_;
+    size_t job_generation_ = 0;
+    size_t active_workers_ = 0;
+    bool quit_ = false;
+};
+
+namespace structread {
+    // Appends one value per line to values, in the order of the lines. If any line fails to parse,
+    // error is set to the error of the first line that failed (with a location relative to the
+    // start of input) and NdjsonResult::ok is false.
+    template <typename T>
+    NdjsonResult from_ndjson(NdjsonParser& parser, std::vector<T>& values, std::span<char> input,
+        bool end_of_input, std::optional<ParseContext::Error>& error)
+    {
+        const auto first = values.size();
+        values.resize(first + NdjsonParser::count_lines(input, end_of_input));
+
+        std::mutex error_mutex;
+        size_t error_line = 0;
+        const auto result = parser.parse(input, end_of_input,
+            [&](Parser& p, size_t line, size_t thread) {
+                const auto line_start = static_cast<size_t>(p.input().data() - input.data());
+                auto& ctx = parser.context(thread);
+                if (from_json(values[first + line], ctx)) {
+                    // The Eof token contains the rest of the line
+                    const auto rest = ctx.parser.next();
+                    const auto extra = rest.string().find_first_not_of(" \t\r");
+                    if (extra == std::string_view::npos) {
+                        return true;
+                    }
+                    ctx.set_error(
+                        ctx.parser.get_location(rest) + extra, "Expected end of line after value");
+                }
+                std::lock_guard lock(error_mutex);
+                if (!error || line < error_line) {
+                    error_line = line;
+                    error = ParseContext::Error {
+                        line_start + ctx.error->location,
+                        std::move(ctx.error->message),
+                    };
+                }
+                return false;
+            });
+        if (!result.ok) {
+            values.resize(first);
+        }
+        return result;
+    }
+}
+
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "minijson2.hpp"
+
+// On-demand access to a few values of a large document, e.g.
+// doc.root()["meta"]["id"].get_uint(), without building a DOM or declaring a struct.
+// Only the values that are asked for are converted, everything in between is jumped over with
+// Parser::skip (so with SkipMode::Fast by default).
+// Since this runs directly on a Parser, it is forward-only: Once the document has moved past a
+// value, that value can not be accessed anymore. In particular object members have to be looked up
+// in the order in which they appear in the document. Accessing a value that is behind the current
+// position fails like a missing key. Whatever follows the root value is not looked at.
+// Like with Parser, strings that a read-only Document had to escape are only valid until the next
+// string is escaped. Keys are copied, so they stay valid until the next key at the same depth.
+namespace minijson2::ondemand {
+
+class Document;
+class ArrayIterator;
+class ObjectIterator;
+
+template <typename Iterator>
+struct Range {
+    Iterator first;
+    Iterator last;
+
+    Iterator begin() const { return first; }
+    Iterator end() const { return last; }
+};
+
+// A handle to a value in a Document. It is cheap to copy and stays usable as long as the document
+// has not moved past it. Missing keys, out of range indices, type mismatches and syntax errors all
+// result in an invalid Value (or nullopt). The latter also set Document::error().
+class Value {
+public:
+    // Invalid
+    Value() = default;
+
+    // Whether the value exists and can still be accessed
+    explicit operator bool() const;
+
+    // Error if the value is invalid, Array or Object after the container has been entered
+    Token::Type type() const;
+
+    bool is_null() const;
+    std::optional<bool> get_bool() const;
+    // Only for UInt
+    std::optional<uint64_t> get_uint() const;
+    // For Int and UInt, if the latter fits
+    std::optional<int64_t> get_int() const;
+    // All numbers are converted
+    std::optional<double> get_double() const;
+    // The string is only escaped once, so this may be called multiple times
+    std::optional<std::string_view> get_string() const;
+
+    // For objects. Searches forward from the member that was accessed last and skips everything
+    // else, so the members in front of it can not be accessed anymore.
+    Value operator[](std::string_view key) const;
+
+    // For arrays. Only indices from the last accessed element on are reachable.
+    Value operator[](size_t index) const;
+
+    // Iteration continues from the current position, just like the lookups
+    Range<ArrayIterator> elements() const;
+    Range<ObjectIterator> members() const;
+
+private:
+    friend class Document;
+    friend class ArrayIterator;
+    friend class ObjectIterator;
+
+    Value(Document* document, size_t depth, const char* start);
+
+    // The first token, if this is the pending value
+    const Token* token() const;
+
+    Document* document_ = nullptr;
+    // The number of entered containers around this value
+    size_t depth_ = 0;
+    // Where the first token of the value starts in the input, to identify it
+    const char* start_ = nullptr;
+};
+
+struct Member {
+    std::string_view key;
+    Value value;
+};
+
+class ArrayIterator {
+public:
+    // End
+    ArrayIterator() = default;
+
+    const Value& operator*() const { return element_; }
+    ArrayIterator& operator++();
+    bool operator==(const ArrayIterator& other) const;
+
+private:
+    friend class Value;
+
+    ArrayIterator(Value array);
+
+    Value array_;
+    Value element_;
+};
+
+class ObjectIterator {
+public:
+    // End
+    ObjectIterator() = default;
+
+    const Member& operator*() const { return member_; }
+    ObjectIterator& operator++();
+    bool operator==(const ObjectIterator& other) const;
+
+private:
+    friend class Value;
+
+    ObjectIterator(Value object);
+
+    Value object_;
+    Member member_;
+};
+
+class Document {
+public:
+    // The same constructors as Parser
+    Document(std::string& input, ParseOptions options = {});
+    Document(std::span<char> input, ParseOptions options = {});
+    Document(std::string_view input, std::string& scratch, ParseOptions options = {});
+
+    // The handles point into the document, so it must not move
+    Document(const Document&) = delete;
+    Document& operator=(const Document&) = delete;
+
+    // Invalid if the document does not start with a valid token
+    Value root();
+
+    // Whether there was a syntax error. Lookups that simply fail do not count.
+    bool failed() const;
+    // Only if failed()
+    const Token& error() const;
+
+    const Parser& parser() const;
+
+private:
+    friend class Value;
+    friend class ArrayIterator;
+    friend class ObjectIterator;
+
+    struct Container {
+        Token token;
+        // Number of elements read so far for arrays
+        size_t index = 0;
+        // Key of the pending member for objects
+        std::string_view key;
+    };
+
+    // A value is either the pending value (At) or an entered container (Inside), otherwise the
+    // parser has moved past it already.
+    enum class Position { At, Inside, Gone };
+
+    void init();
+    Position locate(const Value& value) const;
+    // Like locate, but also skips the rest of all containers entered inside of value, so that it
+    // is the innermost container if it is Inside.
+    Position seek(const Value& value);
+    // The member or element (of the container at depth) that was accessed last, if it has not been
+    // skipped yet
+    Value current_child(size_t depth);
+    // Makes value the innermost container, if it is an array or object of type
+    bool enter(const Value& value, Token::Type type);
+    void set_pending(const Token& token);
+    bool discard_pending();
+    // In the innermost container
+    Value next_element();
+    std::optional<Member> next_member();
+    bool fail(const Token& token);
+
+    Parser parser_;
+    // Containers that have been entered by lookups or iteration, innermost last
+    std::vector<Container> open_;
+    // Copies of the pending keys (by depth) that had escape sequences, since a read-only parser
+    // escapes them into its scratch buffer, which the next escaped string overwrites. A deque, so
+    // that the keys don't move when it grows.
+    std::deque<std::string> escaped_keys_;
+    // The first token of the value that has been read but not consumed yet
+    Token pending_;
+    bool has_pending_ = false;
+    std::optional<std::string_view> pending_string_;
+    const char* root_ = nullptr;
+    Token error_;
+    bool failed_ = false;
+};
+
+}
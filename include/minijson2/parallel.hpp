@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "minijson2.hpp"
+
+namespace minijson2 {
+
+struct ArrayElement {
+    size_t begin;
+    // One past the end, might include trailing whitespace
+    size_t end;
+};
+
+// A fast pre-scan over the input (it only looks at strings and brackets) to find the elements of
+// the array at the top level. Returns false if the input is not an array or the pre-scan can not
+// be sure it found the same elements the parser would find (e.g. because the input is malformed).
+bool find_array_elements(std::string_view input, std::vector<ArrayElement>& elements);
+
+// Calls func(task) for every task in [0, num_tasks). The calling thread is one of the num_threads
+// threads (0 means std::thread::hardware_concurrency()).
+void parallel_for(size_t num_tasks, size_t num_threads, const std::function<void(size_t)>& func);
+
+namespace structread {
+    struct ParallelOptions {
+        // 0 means std::thread::hardware_concurrency()
+        size_t num_threads = 0;
+        // Smaller inputs are parsed on the calling thread with from_json
+        size_t min_size = 1024 * 1024;
+        ParseOptions parse_options;
+    };
+
+    // Like from_json for a document that is a single large array, but the elements are parsed on
+    // multiple threads. Each element gets its own Parser on its slice of the input. If the
+    // pre-scan fails, this falls back to from_json, so the result and errors are always the same.
+    // On error, values is left as it was (like with from_ndjson).
+    template <typename T>
+    bool from_json_parallel(std::vector<T>& values, std::span<char> input,
+        std::optional<ParseContext::Error>& error, const ParallelOptions& options = {})
+    {
+        const auto first = values.size();
+        const auto sequential = [&] {
+            ParseContext ctx(input, options.parse_options);
+            if (from_json(values, ctx)) {
+                return true;
+            }
+            values.resize(first);
+            error = std::move(ctx.error);
+            return false;
+        };
+
+        const auto num_threads = options.num_threads
+            ? options.num_threads
+            : std::max(1u, std::thread::hardware_concurrency());
+        const auto view = std::string_view(input.data(), input.size());
+        std::vector<ArrayElement> elements;
+        if (num_threads == 1 || input.size() < options.min_size
+            || !find_array_elements(view, elements)) {
+            return sequential();
+        }
+
+        values.resize(first + elements.size());
+
+        // The first error in document order is the one with the smallest element index
+        std::mutex error_mutex;
+        std::atomic<size_t> error_index = elements.size();
+        // The first error is something after the value of an element, which the pre-scan does not
+        // notice. The error message depends on what came before it, so it comes from from_json.
+        bool fall_back = false;
+
+        // Batches of elements, so threads don't fight over the task counter
+        const auto batch_size = std::max<size_t>(1, elements.size() / (num_threads * 16));
+        const auto num_batches = (elements.size() + batch_size - 1) / batch_size;
+        parallel_for(num_batches, num_threads, [&](size_t batch) {
+            const Path root;
+            // Reset for every element of the batch
+            ParseContext ctx(std::span<char>(), options.parse_options);
+            const auto end = std::min(elements.size(), (batch + 1) * batch_size);
+            for (size_t i = batch * batch_size; i < end; ++i) {
+                if (i > error_index.load(std::memory_order_relaxed)) {
+                    return;
+                }
+                const auto& elem = elements[i];
+                ctx.reset(input.subspan(elem.begin, elem.end - elem.begin));
+                const auto ok = from_json(values[first + i], ctx, ctx.parser.next(), Path(root, i));
+                // The Eof token contains the rest of the slice
+                const auto trailing = ok
+                    && ctx.parser.next().string().find_first_not_of(" \t\n\r")
+                        != std::string_view::npos;
+                if (!ok || trailing) {
+                    std::lock_guard lock(error_mutex);
+                    if (i < error_index) {
+                        error_index = i;
+                        fall_back = trailing;
+                        if (!trailing) {
+                            error = ParseContext::Error {
+                                elem.begin + ctx.error->location,
+                                std::move(ctx.error->message),
+                            };
+                        }
+                    }
+                    return;
+                }
+            }
+        });
+        if (error_index != elements.size()) {
+            values.resize(first);
+            if (fall_back) {
+                error.reset();
+                return sequential();
+            }
+            return false;
+        }
+        return true;
+    }
+}
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "minijson2.hpp"
+
+namespace minijson2 {
+
+// A compiled path into a document, which is evaluated directly on the token stream of a Parser
+// (with Query::Matcher), so nothing but the matching values is ever looked at. Everything else is
+// jumped over with Parser::skip.
+class Query {
+public:
+    struct Segment {
+        // Matches the object member with this key, if set
+        std::optional<std::string> key;
+        // Matches the array element with this index, if set
+        std::optional<size_t> index;
+        // Matches all members and elements
+        bool wildcard = false;
+    };
+
+    class Matcher;
+
+    // RFC 6901 JSON Pointer, e.g. "/items/0/id" ("~1" and "~0" escape '/' and '~'). The empty
+    // pointer selects the whole document. Segments that are valid array indices also match array
+    // elements. Returns nullopt if the pointer is malformed.
+    static std::optional<Query> pointer(std::string_view pointer);
+
+    // A subset of JSONPath: "$" followed by any number of ".key", "['key']" (or with double
+    // quotes), "[index]", ".*" and "[*]", e.g. "$.items[*].id". Returns nullopt if the path is
+    // malformed or uses anything else (e.g. filters, slices or recursive descent).
+    static std::optional<Query> path(std::string_view path);
+
+    const std::vector<Segment>& segments() const;
+
+private:
+    std::vector<Segment> segments_;
+};
+
+// Returns the matching values of a Query in document order:
+//     Query::Matcher matcher(query, parser);
+//     while (const auto token = matcher.next()) { ... }
+// next() returns the first token of the next matching value, which has to be read completely (or
+// skipped) before calling next() again. It returns Eof after the last match and Error on a syntax
+// error (including those in skipped values, depending on ParseOptions::skip_mode).
+// The matcher reads a single value from the parser (usually the whole document). Nothing after that
+// value is read and for single-value queries nothing after the match either.
+class Query::Matcher {
+public:
+    Matcher(const Query& query, Parser& parser);
+    // Needs a parser from reset() before next() is called
+    explicit Matcher(const Query& query);
+
+    Token next();
+
+    // Start over with another parser (e.g. for the next line of NDJSON), but keep the memory
+    void reset(Parser& parser);
+
+private:
+    struct Frame {
+        Token container;
+        size_t segment;
+        // Of the next element in arrays
+        size_t index = 0;
+        // The segment can not match again in this container (it was a key or an index that has
+        // been found)
+        bool done = false;
+    };
+
+    bool matches_type(size_t segment, Token::Type type) const;
+
+    const Query* query_;
+    Parser* parser_;
+    // The containers on the path to the current position, one per matched segment
+    std::vector<Frame> frames_;
+    // No wildcards, so there is at most one match
+    bool single_value_ = true;
+    bool started_ = false;
+    // Nothing is left to match, e.g. because a single-value query has matched
+    bool finished_ = false;
+};
+
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <array>
+#include <concepts>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "minijson2.hpp"
+
+namespace minijson2 {
+
+struct WriteOptions {
+    // Newlines and indentation (with indent spaces per level) instead of the most compact output
+    bool pretty = false;
+    uint32_t indent = 4;
+};
+
+// SAX-style writer into a growable buffer, which is kept around by clear(), so a reused Writer
+// does not allocate anymore once the buffer is large enough.
+// The Writer inserts commas, colons and indentation, but it does not check that the calls make a
+// valid document (e.g. key() outside of an object), except with assertions.
+class Writer {
+public:
+    Writer(WriteOptions options = {});
+
+    void begin_object();
+    void end_object();
+    void begin_array();
+    void end_array();
+
+    // Only in objects, before every value
+    void key(std::string_view key);
+
+    void null();
+    void value(bool v);
+    void value(int64_t v);
+    void value(uint64_t v);
+    // Non-finite values can not be represented in JSON and are written as null
+    void value(double v);
+    void value(std::string_view str);
+    // Without this, string literals would be converted to bool
+    void value(const char* str) { value(std::string_view(str)); }
+
+    template <std::signed_integral T>
+    void value(T v)
+    {
+        value(static_cast<int64_t>(v));
+    }
+
+    template <std::unsigned_integral T>
+        requires(!std::is_same_v<T, bool>)
+    void value(T v)
+    {
+        value(static_cast<uint64_t>(v));
+    }
+
+    void value(float v) { value(static_cast<double>(v)); }
+
+    // Writes already serialized JSON as a value, without checking it
+    void raw_value(std::string_view json);
+
+    std::string_view output() const;
+
+    // Starts a new document, but keeps the memory
+    void clear();
+
+private:
+    // Comma and indentation before a value or key
+    void separate();
+    void newline();
+    void write_string(std::string_view str);
+
+    std::string buffer_;
+    WriteOptions options_;
+    size_t depth_ = 0;
+    // Whether the current container is still empty
+    bool first_ = true;
+    // The value follows a key, so it needs no separator
+    bool after_key_ = false;
+};
+
+// The counterpart of structread::from_json, based on the same type_meta. Unset std::optional fields
+// are omitted, everything else is always written.
+namespace structwrite {
+    // Declared up front, because ADL does not find the later ones through Writer
+    inline void to_json(bool v, Writer& writer);
+    inline void to_json(std::string_view str, Writer& writer);
+    template <structread::number T>
+    void to_json(T v, Writer& writer);
+    template <typename T>
+    void to_json(const std::optional<T>& opt, Writer& writer);
+    template <typename T, typename Allocator>
+    void to_json(const std::vector<T, Allocator>& vec, Writer& writer);
+    template <typename T, size_t N>
+    void to_json(const std::array<T, N>& arr, Writer& writer);
+    template <typename T>
+    void to_json(std::span<T> span, Writer& writer);
+    template <structread::has_type_meta T>
+    void to_json(const T& obj, Writer& writer);
+
+    inline void to_json(bool v, Writer& writer)
+    {
+        writer.value(v);
+    }
+
+    inline void to_json(std::string_view str, Writer& writer)
+    {
+        writer.value(str);
+    }
+
+    template <structread::number T>
+    void to_json(T v, Writer& writer)
+    {
+        writer.value(v);
+    }
+
+    template <typename T>
+    void to_json(const std::optional<T>& opt, Writer& writer)
+    {
+        if (opt) {
+            to_json(*opt, writer);
+        } else {
+            writer.null();
+        }
+    }
+
+    template <typename T>
+    void to_json(std::span<T> span, Writer& writer)
+    {
+        writer.begin_array();
+        for (const auto& elem : span) {
+            to_json(elem, writer);
+        }
+        writer.end_array();
+    }
+
+    template <typename T, typename Allocator>
+    void to_json(const std::vector<T, Allocator>& vec, Writer& writer)
+    {
+        to_json(std::span<const T>(vec), writer);
+    }
+
+    template <typename T, size_t N>
+    void to_json(const std::array<T, N>& arr, Writer& writer)
+    {
+        to_json(std::span<const T>(arr), writer);
+    }
+
+    template <structread::has_type_meta T>
+    void to_json(const T& obj, Writer& writer)
+    {
+        writer.begin_object();
+        structread::for_each_field(obj, [&writer](std::string_view name, const auto& field) {
+            if constexpr (structread::is_optional_type<decltype(field)>) {
+                if (!field) {
+                    return;
+                }
+            }
+            writer.key(name);
+            to_json(field, writer);
+        });
+        writer.end_object();
+    }
+}
+}
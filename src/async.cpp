@@ -0,0 +1,93 @@
+#include "minijson2/async.hpp"
+
+#include <cassert>
+
+namespace minijson2 {
+
+bool AsyncParser::NextAwaiter::await_ready()
+{
+    token_ = parser_.stream_.next();
+    return token_.type() != Token::Type::NeedInput;
+}
+
+void AsyncParser::NextAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    assert(!parser_.waiting_);
+    handle_ = handle;
+    parser_.waiting_ = this;
+}
+
+AsyncParser::AsyncParser(bool multiple_documents, ParseOptions options)
+    : stream_(multiple_documents, options)
+{
+}
+
+AsyncParser::NextAwaiter AsyncParser::next()
+{
+    return NextAwaiter(*this);
+}
+
+void AsyncParser::feed(std::span<const char> chunk)
+{
+    stream_.feed(chunk);
+    resume();
+}
+
+void AsyncParser::finish()
+{
+    stream_.finish();
+    resume();
+}
+
+void AsyncParser::resume()
+{
+    if (!waiting_) {
+        return;
+    }
+    const auto token = stream_.next();
+    // The chunk did not complete the token, keep waiting
+    if (token.type() == Token::Type::NeedInput) {
+        return;
+    }
+    // The coroutine might wait again before resume() returns
+    const auto awaiter = std::exchange(waiting_, nullptr);
+    awaiter->token_ = token;
+    awaiter->handle_.resume();
+}
+
+bool AsyncParser::waiting() const
+{
+    return waiting_ != nullptr;
+}
+
+const StreamParser& AsyncParser::stream() const
+{
+    return stream_;
+}
+
+std::string_view AsyncParser::parse_string(const Token& token, bool escape_in_place)
+{
+    return stream_.parse_string(token, escape_in_place);
+}
+
+int64_t AsyncParser::parse_int(const Token& token)
+{
+    return stream_.parse_int(token);
+}
+
+uint64_t AsyncParser::parse_uint(const Token& token)
+{
+    return stream_.parse_uint(token);
+}
+
+double AsyncParser::parse_float(const Token& token)
+{
+    return stream_.parse_float(token);
+}
+
+bool AsyncParser::parse_bool(const Token& token)
+{
+    return stream_.parse_bool(token);
+}
+
+}
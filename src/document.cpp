@@ -0,0 +1,604 @@
+#include "minijson2/document.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+
+namespace minijson2 {
+
+namespace {
+    struct SerializedHeader {
+        char magic[4];
+        uint32_t version;
+        // Written as 1, to notice a different byte order
+        uint32_t byte_order;
+        // sizeof(Document::Node), to notice a different layout
+        uint32_t node_size;
+        uint64_t num_nodes;
+        uint64_t strings_size;
+    };
+    static_assert(sizeof(SerializedHeader) % alignof(Document::Node) == 0);
+
+    constexpr char serialized_magic[4] = { 'M', 'J', '2', 'D' };
+    // Has to be incremented whenever Document::Node or Token::Type change
+    constexpr uint32_t serialized_version = 1;
+}
+
+bool Document::parse(Parser& parser)
+{
+    clear();
+    strings_ = parser.input();
+    // A rough guess for the number of nodes, so the first parse does not have to reallocate much.
+    // Later parses will reuse the memory anyway.
+    nodes_.reserve(parser.input().size() / 16);
+    if (!parse_nodes<false>(parser, 0, nodes_, sources_)) {
+        clear();
+        return false;
+    }
+    return true;
+}
+
+bool Document::parse_editable(std::string_view input, std::string& scratch, ParseOptions options)
+{
+    Parser parser(input, scratch, options);
+    clear();
+    strings_ = input;
+    nodes_.reserve(input.size() / 16);
+    sources_.reserve(input.size() / 16);
+    if (!parse_nodes<true>(parser, 0, nodes_, sources_)) {
+        clear();
+        return false;
+    }
+    return true;
+}
+
+bool Document::reparse(std::string_view input, size_t edit_begin, size_t old_size,
+    std::string& scratch, ParseOptions options)
+{
+    // Not from parse_editable (or it failed)
+    if (sources_.empty()) {
+        return parse_editable(input, scratch, options);
+    }
+    assert(input.size() + old_size >= strings_.size());
+    const auto edit_end = edit_begin + old_size;
+    // Of everything behind the edit
+    const auto shift = static_cast<int64_t>(input.size()) - static_cast<int64_t>(strings_.size());
+    const auto container = find_enclosing_container(edit_begin, edit_end);
+    if (!container) {
+        return parse_editable(input, scratch, options);
+    }
+
+    // The brackets of the container are outside of the edit, so it is still an array or object
+    // that starts at the same place. Only if it also still ends at the same place (shifted by the
+    // edit), the rest of the document is unaffected.
+    const auto index = *container;
+    const auto begin = sources_[index].begin;
+    const auto end = static_cast<size_t>(static_cast<int64_t>(sources_[index].end) + shift);
+    const auto old_strings = strings_;
+    strings_ = input;
+    Parser parser(input.substr(begin, end - begin), scratch, options);
+    spliced_nodes_.clear();
+    spliced_sources_.clear();
+    // Anything left over means that the container ends somewhere else now. Errors are left to the
+    // full parse as well, so they are reported like for a fresh parse.
+    if (!parse_nodes<true>(parser, begin, spliced_nodes_, spliced_sources_)
+        || !parser.next().string().empty()) {
+        strings_ = old_strings;
+        return parse_editable(input, scratch, options);
+    }
+    splice(index, shift);
+    return true;
+}
+
+std::optional<size_t> Document::find_enclosing_container(size_t edit_begin, size_t edit_end) const
+{
+    // The last node that starts before the edit (sources are sorted, because both the nodes and
+    // the input are in document order) is either inside the container or the container itself.
+    const auto it = std::upper_bound(sources_.begin(), sources_.end(), edit_begin,
+        [](size_t offset, const Source& source) { return offset < source.begin; });
+    if (it == sources_.begin()) {
+        return std::nullopt;
+    }
+    auto index = static_cast<uint32_t>(it - sources_.begin() - 1);
+    while (index != no_parent) {
+        const auto& source = sources_[index];
+        const auto type = nodes_[index].type;
+        // The edit must not touch the brackets
+        if ((type == Token::Type::Array || type == Token::Type::Object) && source.begin < edit_begin
+            && edit_end < source.end) {
+            return index;
+        }
+        index = source.parent;
+    }
+    return std::nullopt;
+}
+
+void Document::splice(size_t index, int64_t shift)
+{
+    const auto old_end = nodes_[index].end;
+    const auto new_size = spliced_nodes_.size();
+    const auto node_shift = static_cast<int64_t>(new_size) - static_cast<int64_t>(old_end - index);
+    const auto move = [](auto value, int64_t offset) {
+        return static_cast<decltype(value)>(static_cast<int64_t>(value) + offset);
+    };
+
+    // Nothing moves if only values were changed (the common case in an editor)
+    if (shift != 0 || node_shift != 0) {
+        // Everything behind the container moves by the edit
+        for (size_t i = old_end; i < nodes_.size(); ++i) {
+            auto& node = nodes_[i];
+            auto& source = sources_[i];
+            if (node.type == Token::Type::Array || node.type == Token::Type::Object) {
+                node.end = move(node.end, node_shift);
+                source.end = move(source.end, shift);
+            } else if (node.type == Token::Type::String && !node.owned) {
+                node.offset = move(node.offset, shift);
+            }
+            source.begin = move(source.begin, shift);
+            if (source.parent != no_parent && source.parent >= old_end) {
+                source.parent = move(source.parent, node_shift);
+            }
+        }
+        // The containers around it get longer or shorter
+        for (auto parent = sources_[index].parent; parent != no_parent;
+             parent = sources_[parent].parent) {
+            nodes_[parent].end = move(nodes_[parent].end, node_shift);
+            sources_[parent].end = move(sources_[parent].end, shift);
+        }
+    }
+
+    // The copied strings of the replaced nodes are not needed anymore
+    for (size_t i = index; i < old_end; ++i) {
+        if (nodes_[i].type == Token::Type::String && nodes_[i].owned) {
+            unused_owned_bytes_ += nodes_[i].size;
+        }
+    }
+
+    // The new nodes were numbered from 0
+    const auto parent = sources_[index].parent;
+    for (size_t i = 0; i < new_size; ++i) {
+        auto& node = spliced_nodes_[i];
+        auto& source = spliced_sources_[i];
+        if (node.type == Token::Type::Array || node.type == Token::Type::Object) {
+            node.end += index;
+        }
+        source.parent = source.parent == no_parent ? parent : source.parent + index;
+    }
+    if (node_shift > 0) {
+        nodes_.insert(nodes_.begin() + old_end, node_shift, Node {});
+        sources_.insert(sources_.begin() + old_end, node_shift, Source {});
+    } else if (node_shift < 0) {
+        nodes_.erase(nodes_.begin() + old_end + node_shift, nodes_.begin() + old_end);
+        sources_.erase(sources_.begin() + old_end + node_shift, sources_.begin() + old_end);
+    }
+    std::copy(spliced_nodes_.begin(), spliced_nodes_.end(), nodes_.begin() + index);
+    std::copy(spliced_sources_.begin(), spliced_sources_.end(), sources_.begin() + index);
+
+    // Otherwise every edit in a container with escaped strings would grow them without bound.
+    // Compacting goes over all nodes, so waiting until at least half of the strings and as many
+    // bytes as there are nodes are unused keeps it amortized O(1) per copied byte.
+    if (unused_owned_bytes_ > std::max(owned_strings_.size() / 2, nodes_.size())) {
+        compact_owned_strings();
+    }
+}
+
+void Document::compact_owned_strings()
+{
+    compacted_strings_.clear();
+    for (auto& node : nodes_) {
+        if (node.type == Token::Type::String && node.owned) {
+            const auto offset = compacted_strings_.size();
+            compacted_strings_.append(owned_strings_, node.offset, node.size);
+            node.offset = offset;
+        }
+    }
+    owned_strings_.swap(compacted_strings_);
+    unused_owned_bytes_ = 0;
+}
+
+template <bool track_sources>
+bool Document::parse_nodes(
+    Parser& parser, size_t base, std::vector<Node>& nodes, std::vector<Source>& sources)
+{
+    stack_.clear();
+    auto token = parser.next();
+    while (true) {
+        const auto type = token.type();
+        if (type == Token::Type::Error) {
+            error_ = token;
+            return false;
+        }
+
+        if (type == Token::Type::EndArray || type == Token::Type::EndObject) {
+            auto& container = nodes[stack_.back()];
+            container.end = nodes.size();
+            if (type == Token::Type::EndObject) {
+                // Counted keys and values separately
+                container.size /= 2;
+            }
+            if constexpr (track_sources) {
+                sources[stack_.back()].end = base + parser.get_location(token) + 1;
+            }
+            stack_.pop_back();
+        } else {
+            assert(token); // Eof is not possible before the document is complete
+            if constexpr (track_sources) {
+                sources.push_back(Source { base + parser.get_location(token), 0,
+                    stack_.empty() ? no_parent : stack_.back() });
+            }
+            if (!stack_.empty()) {
+                nodes[stack_.back()].size++;
+            }
+
+            auto& node = nodes.emplace_back();
+            node.type = type;
+            switch (type) {
+            case Token::Type::Null:
+                node.uint = 0;
+                break;
+            case Token::Type::Bool:
+                node.boolean = parser.parse_bool(token);
+                break;
+            case Token::Type::UInt:
+                node.uint = parser.parse_uint(token);
+                break;
+            case Token::Type::Int:
+                node.int_ = parser.parse_int(token);
+                break;
+            case Token::Type::Float:
+                node.float_ = parser.parse_float(token);
+                break;
+            case Token::Type::String: {
+                const auto str = parser.parse_string(token);
+                node.size = static_cast<uint32_t>(str.size());
+                // std::less and friends give a total order even for unrelated pointers
+                const auto in_input = std::greater_equal<const char*>()(str.data(), strings_.data())
+                    && std::less_equal<const char*>()(
+                        str.data(), strings_.data() + strings_.size());
+                if (in_input) {
+                    node.offset = static_cast<uint64_t>(str.data() - strings_.data());
+                } else {
+                    // Escaped into the scratch buffer of a read-only parser
+                    node.owned = true;
+                    node.offset = owned_strings_.size();
+                    owned_strings_.append(str);
+                }
+                break;
+            }
+            case Token::Type::Array:
+            case Token::Type::Object:
+                node.end = 0;
+                stack_.push_back(static_cast<uint32_t>(nodes.size() - 1));
+                break;
+            default:
+                std::abort();
+            }
+        }
+
+        if (stack_.empty()) {
+            return true;
+        }
+        token = parser.next();
+    }
+}
+
+void Document::clear()
+{
+    nodes_.clear();
+    loaded_nodes_ = {};
+    sources_.clear();
+    stack_.clear();
+    strings_ = {};
+    owned_strings_.clear();
+    unused_owned_bytes_ = 0;
+}
+
+void Document::serialize(std::string& out) const
+{
+    const auto nodes = this->nodes();
+    assert(!nodes.empty());
+
+    // Strings are written in the order of their first occurence
+    std::unordered_map<std::string_view, uint64_t> string_offsets;
+    size_t strings_size = 0;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i].type == Token::Type::String) {
+            const auto str = Value(this, i).as_string();
+            if (string_offsets.emplace(str, strings_size).second) {
+                strings_size += str.size();
+            }
+        }
+    }
+
+    const auto header = SerializedHeader {
+        .magic = { serialized_magic[0], serialized_magic[1], serialized_magic[2],
+            serialized_magic[3] },
+        .version = serialized_version,
+        .byte_order = 1,
+        .node_size = sizeof(Node),
+        .num_nodes = nodes.size(),
+        .strings_size = strings_size,
+    };
+    const auto nodes_size = nodes.size() * sizeof(Node);
+    out.resize(sizeof(header) + nodes_size + strings_size);
+    const auto nodes_out = out.data() + sizeof(header);
+    const auto strings_out = nodes_out + nodes_size;
+    std::memcpy(out.data(), &header, sizeof(header));
+    std::memcpy(nodes_out, nodes.data(), nodes_size);
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i].type != Token::Type::String) {
+            continue;
+        }
+        const auto str = Value(this, i).as_string();
+        auto node = nodes[i];
+        node.owned = false;
+        node.offset = string_offsets.at(str);
+        std::memcpy(nodes_out + i * sizeof(Node), &node, sizeof(Node));
+        // Duplicates are simply written again at the same place
+        std::memcpy(strings_out + node.offset, str.data(), str.size());
+    }
+}
+
+bool Document::save(const char* path) const
+{
+    std::string data;
+    serialize(data);
+    FILE* f = std::fopen(path, "wb");
+    if (!f) {
+        return false;
+    }
+    const auto written = std::fwrite(data.data(), 1, data.size(), f);
+    const auto closed = std::fclose(f) == 0;
+    return written == data.size() && closed;
+}
+
+bool Document::load(std::string_view data)
+{
+    clear();
+    const auto fail = [this](const char* message) {
+        error_ = Token(0, message);
+        return false;
+    };
+
+    SerializedHeader header;
+    if (data.size() < sizeof(header)) {
+        return fail("Serialized document is truncated");
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, serialized_magic, sizeof(serialized_magic)) != 0) {
+        return fail("Not a serialized document");
+    }
+    if (header.version != serialized_version || header.byte_order != 1
+        || header.node_size != sizeof(Node)) {
+        return fail("Serialized document is from a different version or platform");
+    }
+    const auto max_nodes = (data.size() - sizeof(header)) / sizeof(Node);
+    if (header.num_nodes == 0 || header.num_nodes > max_nodes
+        || header.strings_size != data.size() - sizeof(header) - header.num_nodes * sizeof(Node)) {
+        return fail("Serialized document is truncated");
+    }
+    if (reinterpret_cast<uintptr_t>(data.data()) % alignof(Node) != 0) {
+        return fail("Serialized document is not aligned");
+    }
+
+    const auto nodes_size = header.num_nodes * sizeof(Node);
+    const auto nodes = std::span<const Node>(
+        reinterpret_cast<const Node*>(data.data() + sizeof(header)), header.num_nodes);
+    const auto& root = nodes[0];
+    const auto root_end
+        = root.type == Token::Type::Array || root.type == Token::Type::Object ? root.end : 1;
+    if (root_end != nodes.size()) {
+        return fail("Serialized document is corrupt");
+    }
+    loaded_nodes_ = nodes;
+    strings_ = data.substr(sizeof(header) + nodes_size);
+    return true;
+}
+
+Document::Value Document::root() const
+{
+    assert(!nodes().empty());
+    return Value(this, 0);
+}
+
+const Token& Document::error() const
+{
+    return error_;
+}
+
+size_t Document::num_nodes() const
+{
+    return nodes().size();
+}
+
+const Document::Node& Document::node(size_t index) const
+{
+    assert(index < nodes().size());
+    return nodes()[index];
+}
+
+std::span<const Document::Node> Document::nodes() const
+{
+    return loaded_nodes_.empty() ? std::span<const Node>(nodes_) : loaded_nodes_;
+}
+
+Document::Value::Value(const Document* document, size_t index) : document_(document), index_(index)
+{
+}
+
+const Document::Node& Document::Value::node() const
+{
+    return document_->nodes()[index_];
+}
+
+size_t Document::Value::next() const
+{
+    const auto& n = node();
+    if (n.type == Token::Type::Array || n.type == Token::Type::Object) {
+        return n.end;
+    }
+    return index_ + 1;
+}
+
+Token::Type Document::Value::type() const
+{
+    return node().type;
+}
+
+bool Document::Value::is_null() const
+{
+    return type() == Token::Type::Null;
+}
+
+bool Document::Value::is_bool() const
+{
+    return type() == Token::Type::Bool;
+}
+
+bool Document::Value::is_number() const
+{
+    const auto t = type();
+    return t == Token::Type::UInt || t == Token::Type::Int || t == Token::Type::Float;
+}
+
+bool Document::Value::is_string() const
+{
+    return type() == Token::Type::String;
+}
+
+bool Document::Value::is_array() const
+{
+    return type() == Token::Type::Array;
+}
+
+bool Document::Value::is_object() const
+{
+    return type() == Token::Type::Object;
+}
+
+bool Document::Value::as_bool() const
+{
+    assert(is_bool());
+    return node().boolean;
+}
+
+uint64_t Document::Value::as_uint() const
+{
+    assert(type() == Token::Type::UInt);
+    return node().uint;
+}
+
+int64_t Document::Value::as_int() const
+{
+    assert(type() == Token::Type::UInt || type() == Token::Type::Int);
+    if (type() == Token::Type::UInt) {
+        assert(node().uint <= static_cast<uint64_t>(std::numeric_limits<int64_t>::max()));
+        return static_cast<int64_t>(node().uint);
+    }
+    return node().int_;
+}
+
+double Document::Value::as_double() const
+{
+    switch (type()) {
+    case Token::Type::UInt:
+        return static_cast<double>(node().uint);
+    case Token::Type::Int:
+        // "-0" is the only negative zero, like in Parser::parse_float
+        return node().int_ == 0 ? -0.0 : static_cast<double>(node().int_);
+    case Token::Type::Float:
+        return node().float_;
+    default:
+        assert(false && "Value is not a number");
+        return 0.0;
+    }
+}
+
+std::string_view Document::Value::as_string() const
+{
+    assert(is_string());
+    const auto& n = node();
+    const auto base = n.owned ? document_->owned_strings_.data() : document_->strings_.data();
+    return std::string_view(base + n.offset, n.size);
+}
+
+size_t Document::Value::size() const
+{
+    if (is_array() || is_object()) {
+        return node().size;
+    }
+    return 0;
+}
+
+Document::Value Document::Value::operator[](size_t index) const
+{
+    assert(is_array());
+    assert(index < size());
+    auto it = elements().begin();
+    for (size_t i = 0; i < index; ++i) {
+        ++it;
+    }
+    return *it;
+}
+
+std::optional<Document::Value> Document::Value::find(std::string_view key) const
+{
+    assert(is_object());
+    for (const auto& member : members()) {
+        if (member.key == key) {
+            return member.value;
+        }
+    }
+    return std::nullopt;
+}
+
+Document::Range<Document::ArrayIterator> Document::Value::elements() const
+{
+    assert(is_array());
+    return { ArrayIterator(document_, index_ + 1), ArrayIterator(document_, next()) };
+}
+
+Document::Range<Document::ObjectIterator> Document::Value::members() const
+{
+    assert(is_object());
+    return { ObjectIterator(document_, index_ + 1), ObjectIterator(document_, next()) };
+}
+
+Document::ArrayIterator::ArrayIterator(const Document* document, size_t index)
+    : document_(document)
+    , index_(index)
+{
+}
+
+Document::Value Document::ArrayIterator::operator*() const
+{
+    return Value(document_, index_);
+}
+
+Document::ArrayIterator& Document::ArrayIterator::operator++()
+{
+    index_ = Value(document_, index_).next();
+    return *this;
+}
+
+Document::ObjectIterator::ObjectIterator(const Document* document, size_t index)
+    : document_(document)
+    , index_(index)
+{
+}
+
+Document::Member Document::ObjectIterator::operator*() const
+{
+    return Member { Value(document_, index_).as_string(), Value(document_, index_ + 1) };
+}
+
+Document::ObjectIterator& Document::ObjectIterator::operator++()
+{
+    index_ = Value(document_, index_ + 1).next();
+    return *this;
+}
+
+}
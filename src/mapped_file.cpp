@@ -0,0 +1,108 @@
+#include "minijson2/mapped_file.hpp"
+
+#include <cstdio>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MINIJSON2_HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace minijson2 {
+
+std::optional<MappedFile> MappedFile::open(const char* path)
+{
+    MappedFile file;
+#ifdef MINIJSON2_HAS_MMAP
+    const auto fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return std::nullopt;
+    }
+    file.size_ = static_cast<size_t>(st.st_size);
+    // Mapping an empty file fails, but there is nothing to map anyway
+    if (file.size_ > 0) {
+        auto addr = ::mmap(nullptr, file.size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            ::close(fd);
+            return std::nullopt;
+        }
+        // We read it front to back
+        ::madvise(addr, file.size_, MADV_SEQUENTIAL);
+        file.data_ = static_cast<const char*>(addr);
+    }
+    // The mapping stays valid after closing the file descriptor
+    ::close(fd);
+#else
+    FILE* f = std::fopen(path, "rb");
+    if (!f) {
+        return std::nullopt;
+    }
+    std::fseek(f, 0, SEEK_END);
+    const auto size = std::ftell(f);
+    if (size < 0) {
+        std::fclose(f);
+        return std::nullopt;
+    }
+    std::fseek(f, 0, SEEK_SET);
+    file.buffer_.resize(size);
+    const auto read = std::fread(file.buffer_.data(), 1, size, f);
+    std::fclose(f);
+    if (read != static_cast<size_t>(size)) {
+        return std::nullopt;
+    }
+#endif
+    return file;
+}
+
+MappedFile::MappedFile(MappedFile&& other)
+    : data_(std::exchange(other.data_, nullptr))
+    , size_(std::exchange(other.size_, 0))
+    , buffer_(std::move(other.buffer_))
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other)
+{
+    if (this != &other) {
+        unmap();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        buffer_ = std::move(other.buffer_);
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile()
+{
+    unmap();
+}
+
+std::string_view MappedFile::data() const
+{
+#ifdef MINIJSON2_HAS_MMAP
+    return std::string_view(data_, size_);
+#else
+    return buffer_;
+#endif
+}
+
+void MappedFile::unmap()
+{
+#ifdef MINIJSON2_HAS_MMAP
+    if (data_) {
+        ::munmap(const_cast<char*>(data_), size_);
+    }
+#endif
+    data_ = nullptr;
+    size_ = 0;
+}
+
+}
@@ -0,0 +1,1052 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <minijson2/document.hpp>
+#include <minijson2/minijson2.hpp>
+#include <minijson2/ndjson.hpp>
+#include <minijson2/ondemand.hpp>
+#include <minijson2/query.hpp>
+#include <minijson2/writer.hpp>
+
+using namespace minijson2;
+
+// Counts all allocations, so every benchmark can report how many allocations a parse needs
+std::atomic<size_t> num_allocations = 0;
+
+void* operator new(size_t size)
+{
+    num_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+// The corpora are generated, so the results are reproducible without shipping megabytes of test
+// data. They imitate the structure of the usual benchmark files (twitter.json, canada.json and
+// citm_catalog.json from nativejson-benchmark), a glTF file and NDJSON logs.
+
+// splitmix64, because the distributions in <random> are not the same everywhere
+class Random {
+public:
+    uint64_t next()
+    {
+        state_ += 0x9E37'79B9'7F4A'7C15;
+        auto z = state_;
+        z = (z ^ (z >> 30)) * 0xBF58'476D'1CE4'E5B9;
+        z = (z ^ (z >> 27)) * 0x94D0'49BB'1331'11EB;
+        return z ^ (z >> 31);
+    }
+
+    // [0, n)
+    uint64_t below(uint64_t n) { return next() % n; }
+
+    // [lo, hi)
+    double real(double lo, double hi)
+    {
+        return lo + (hi - lo) * static_cast<double>(next() >> 11) / static_cast<double>(1ull << 53);
+    }
+
+    bool chance(double p) { return real(0.0, 1.0) < p; }
+
+    template <typename T>
+    const T& pick(const std::vector<T>& values)
+    {
+        return values[below(values.size())];
+    }
+
+private:
+    uint64_t state_ = 0x6A09'E667'F3BC'C908;
+};
+
+const std::vector<std::string> words = { "the", "of", "and", "json", "parser", "fast", "memory",
+    "token", "stream", "value", "über", "naïve", "café", "日本語", "テスト", "東京", "😀", "🚀",
+    "hello", "world", "benchmark", "\"quoted\"", "line\nbreak", "tab\tbed", "#hashtag", "@user" };
+
+std::string sentence(Random& rng, size_t num_words)
+{
+    std::string str;
+    for (size_t i = 0; i < num_words; ++i) {
+        if (i > 0) {
+            str.push_back(' ');
+        }
+        str.append(rng.pick(words));
+    }
+    return str;
+}
+
+std::string identifier(Random& rng, size_t len)
+{
+    std::string str;
+    for (size_t i = 0; i < len; ++i) {
+        str.push_back(static_cast<char>('a' + rng.below(26)));
+    }
+    return str;
+}
+
+std::string generate_twitter()
+{
+    Random rng;
+    Writer w({ .pretty = true, .indent = 2 });
+    w.begin_object();
+    w.key("statuses");
+    w.begin_array();
+    for (size_t i = 0; i < 800; ++i) {
+        const auto id = 505'874'924'095'815'681ull + rng.below(1'000'000'000);
+        w.begin_object();
+        w.key("metadata");
+        w.begin_object();
+        w.key("result_type");
+        w.value("recent");
+        w.key("iso_language_code");
+        w.value(rng.chance(0.7) ? "ja" : "en");
+        w.end_object();
+        w.key("created_at");
+        w.value("Sun Aug 31 00:29:15 +0000 2014");
+        w.key("id");
+        w.value(id);
+        w.key("id_str");
+        w.value(std::to_string(id));
+        w.key("text");
+        if (rng.chance(0.2)) {
+            // The real file has plenty of these
+            w.raw_value(R"("@aym0566x \n\n\u540d\u524d:\u524d\u7530\u3042\u3086\u307f\n)"
+                        R"(\u7b2c\u4e00\u5370\u8c61:\u306a\u3093\u304b\u6016\u3063\uff01\n)"
+                        R"(\u4eca\u306e\u5370\u8c61")");
+        } else {
+            w.value(sentence(rng, 5 + rng.below(15)));
+        }
+        w.key("source");
+        w.value(R"(<a href="https://mobile.twitter.com" rel="nofollow">Mobile Web (M2)</a>)");
+        w.key("truncated");
+        w.value(false);
+        if (rng.chance(0.3)) {
+            w.key("in_reply_to_status_id");
+            w.value(id - rng.below(100'000));
+        }
+        w.key("user");
+        w.begin_object();
+        w.key("id");
+        w.value(rng.below(3'000'000'000));
+        w.key("name");
+        w.value(sentence(rng, 2));
+        w.key("screen_name");
+        w.value(identifier(rng, 5 + rng.below(10)));
+        w.key("location");
+        w.value(rng.chance(0.5) ? "東京" : "");
+        w.key("description");
+        w.value(sentence(rng, 10 + rng.below(20)));
+        w.key("followers_count");
+        w.value(rng.below(100'000));
+        w.key("friends_count");
+        w.value(rng.below(5'000));
+        w.key("verified");
+        w.value(rng.chance(0.05));
+        w.key("profile_image_url");
+        w.value("http://pbs.twimg.com/profile_images/" + std::to_string(rng.below(1ull << 40))
+            + "/" + identifier(rng, 8) + "_normal.jpeg");
+        w.end_object();
+        w.key("geo");
+        w.null();
+        w.key("coordinates");
+        w.null();
+        w.key("place");
+        w.null();
+        w.key("retweet_count");
+        w.value(rng.below(1000));
+        w.key("favorite_count");
+        w.value(rng.below(1000));
+        w.key("entities");
+        w.begin_object();
+        w.key("hashtags");
+        w.begin_array();
+        for (size_t h = rng.below(3); h > 0; --h) {
+            w.begin_object();
+            w.key("text");
+            w.value(rng.pick(words));
+            w.key("indices");
+            const auto start = rng.below(100);
+            w.begin_array();
+            w.value(start);
+            w.value(start + 1 + rng.below(10));
+            w.end_array();
+            w.end_object();
+        }
+        w.end_array();
+        w.key("urls");
+        w.begin_array();
+        w.end_array();
+        w.key("user_mentions");
+        w.begin_array();
+        for (size_t m = rng.below(3); m > 0; --m) {
+            w.begin_object();
+            w.key("screen_name");
+            w.value(identifier(rng, 8));
+            w.key("name");
+            w.value(sentence(rng, 2));
+            w.key("id");
+            w.value(rng.below(3'000'000'000));
+            w.end_object();
+        }
+        w.end_array();
+        w.end_object();
+        w.key("favorited");
+        w.value(false);
+        w.key("retweeted");
+        w.value(rng.chance(0.1));
+        w.key("lang");
+        w.value("ja");
+        w.end_object();
+    }
+    w.end_array();
+    w.key("search_metadata");
+    w.begin_object();
+    w.key("completed_in");
+    w.value(0.087);
+    w.key("max_id");
+    w.value(505'874'924'095'815'681ull);
+    w.key("query");
+    w.value("%E4%B8%80");
+    w.key("count");
+    w.value(800);
+    w.end_object();
+    w.end_object();
+    return std::string(w.output());
+}
+
+std::string generate_canada()
+{
+    Random rng;
+    Writer w;
+    w.begin_object();
+    w.key("type");
+    w.value("FeatureCollection");
+    w.key("features");
+    w.begin_array();
+    w.begin_object();
+    w.key("type");
+    w.value("Feature");
+    w.key("properties");
+    w.begin_object();
+    w.key("name");
+    w.value("Canada");
+    w.end_object();
+    w.key("geometry");
+    w.begin_object();
+    w.key("type");
+    w.value("Polygon");
+    w.key("coordinates");
+    w.begin_array();
+    for (size_t ring = 0; ring < 480; ++ring) {
+        w.begin_array();
+        // All digits, like in the real file
+        auto lon = rng.real(-140.0, -50.0);
+        auto lat = rng.real(42.0, 83.0);
+        for (size_t i = 0, n = 20 + rng.below(200); i < n; ++i) {
+            lon += rng.real(-0.01, 0.01);
+            lat += rng.real(-0.01, 0.01);
+            w.begin_array();
+            w.value(lon);
+            w.value(lat);
+            w.end_array();
+        }
+        w.end_array();
+    }
+    w.end_array();
+    w.end_object();
+    w.end_object();
+    w.end_array();
+    w.end_object();
+    return std::string(w.output());
+}
+
+std::string generate_citm()
+{
+    Random rng;
+    Writer w({ .pretty = true });
+    std::vector<uint64_t> event_ids;
+    for (size_t i = 0; i < 180; ++i) {
+        event_ids.push_back(138'586'341 + rng.below(1'000'000));
+    }
+    w.begin_object();
+    // These are maps from ids to names, which is what makes this file hard for structread
+    w.key("areaNames");
+    w.begin_object();
+    for (size_t i = 0; i < 20; ++i) {
+        w.key(std::to_string(205'705'993 + i));
+        w.value("Arrière-scène " + identifier(rng, 6));
+    }
+    w.end_object();
+    w.key("events");
+    w.begin_object();
+    for (const auto id : event_ids) {
+        w.key(std::to_string(id));
+        w.begin_object();
+        w.key("description");
+        w.null();
+        w.key("id");
+        w.value(id);
+        w.key("name");
+        w.value(sentence(rng, 3));
+        w.key("subTopicIds");
+        w.begin_array();
+        for (size_t s = 1 + rng.below(4); s > 0; --s) {
+            w.value(337'184'262 + rng.below(1000));
+        }
+        w.end_array();
+        w.end_object();
+    }
+    w.end_object();
+    w.key("performances");
+    w.begin_array();
+    for (size_t p = 0; p < 240; ++p) {
+        w.begin_object();
+        w.key("eventId");
+        w.value(rng.pick(event_ids));
+        w.key("id");
+        w.value(339'887'544 + p);
+        w.key("logo");
+        w.null();
+        w.key("name");
+        w.null();
+        w.key("prices");
+        w.begin_array();
+        for (size_t i = 1 + rng.below(6); i > 0; --i) {
+            w.begin_object();
+            w.key("amount");
+            w.value(10'000 + rng.below(200) * 250);
+            w.key("audienceSubCategoryId");
+            w.value(337'100'890);
+            w.key("seatCategoryId");
+            w.value(338'937'295 + rng.below(20));
+            w.end_object();
+        }
+        w.end_array();
+        w.key("seatCategories");
+        w.begin_array();
+        for (size_t i = 1 + rng.below(6); i > 0; --i) {
+            w.begin_object();
+            w.key("areas");
+            w.begin_array();
+            for (size_t a = 1 + rng.below(10); a > 0; --a) {
+                w.begin_object();
+                w.key("areaId");
+                w.value(205'705'993 + rng.below(20));
+                w.key("blockIds");
+                w.begin_array();
+                w.end_array();
+                w.end_object();
+            }
+            w.end_array();
+            w.key("seatCategoryId");
+            w.value(338'937'295 + rng.below(20));
+            w.end_object();
+        }
+        w.end_array();
+        w.key("seatMapImage");
+        w.null();
+        w.key("start");
+        w.value(1'372'701'600'000ull + rng.below(100'000'000'000ull));
+        w.key("venueCode");
+        w.value("PLEYEL_PLEYEL");
+        w.end_object();
+    }
+    w.end_array();
+    w.end_object();
+    return std::string(w.output());
+}
+
+std::string generate_logs()
+{
+    Random rng;
+    const std::vector<std::string> levels = { "debug", "info", "info", "info", "warn", "error" };
+    const std::vector<std::string> services = { "api", "auth", "billing", "search", "gateway" };
+    const std::vector<std::string> paths = { "/users", "/orders", "/search?q=json", "/login" };
+    Writer w;
+    for (size_t i = 0; i < 25'000; ++i) {
+        w.begin_object();
+        w.key("ts");
+        w.value(1'700'000'000'000ull + i * 37 + rng.below(37));
+        w.key("level");
+        w.value(rng.pick(levels));
+        w.key("service");
+        w.value(rng.pick(services));
+        w.key("msg");
+        w.value("GET " + rng.pick(paths) + "/" + std::to_string(rng.below(100'000)) + " took "
+            + std::to_string(rng.below(500)) + "ms");
+        w.key("latency_ms");
+        w.value(static_cast<double>(rng.below(500'000)) / 1000.0);
+        w.key("status");
+        w.value(rng.chance(0.9) ? 200 : 500);
+        w.key("tags");
+        w.begin_array();
+        for (size_t t = rng.below(4); t > 0; --t) {
+            w.value(identifier(rng, 4));
+        }
+        w.end_array();
+        if (rng.chance(0.5)) {
+            w.key("user");
+            w.value(identifier(rng, 10));
+        }
+        w.end_object();
+    }
+    // The writer separates documents with newlines, but NDJSON ends with one too
+    return std::string(w.output()) + "\n";
+}
+
+// structread schemas for the corpora
+
+struct TwitterMetadata {
+    std::string result_type;
+    std::string iso_language_code;
+};
+MJ2_TYPE_META(TwitterMetadata, result_type, iso_language_code)
+
+struct TwitterUser {
+    uint64_t id;
+    std::string name;
+    std::string screen_name;
+    std::string location;
+    std::string description;
+    uint32_t followers_count;
+    uint32_t friends_count;
+    bool verified;
+    std::string profile_image_url;
+};
+MJ2_TYPE_META(TwitterUser, id, name, screen_name, location, description, followers_count,
+    friends_count, verified, profile_image_url)
+
+struct Hashtag {
+    std::string text;
+    std::array<uint32_t, 2> indices;
+};
+MJ2_TYPE_META(Hashtag, text, indices)
+
+struct UserMention {
+    std::string screen_name;
+    std::string name;
+    uint64_t id;
+};
+MJ2_TYPE_META(UserMention, screen_name, name, id)
+
+struct Entities {
+    std::vector<Hashtag> hashtags;
+    std::vector<std::string> urls;
+    std::vector<UserMention> user_mentions;
+};
+MJ2_TYPE_META(Entities, hashtags, urls, user_mentions)
+
+struct Status {
+    TwitterMetadata metadata;
+    std::string created_at;
+    uint64_t id;
+    std::string id_str;
+    std::string text;
+    std::string source;
+    bool truncated;
+    std::optional<uint64_t> in_reply_to_status_id;
+    TwitterUser user;
+    uint32_t retweet_count;
+    uint32_t favorite_count;
+    Entities entities;
+    bool favorited;
+    bool retweeted;
+    std::string lang;
+};
+MJ2_TYPE_META(Status, metadata, created_at, id, id_str, text, source, truncated,
+    in_reply_to_status_id, user, retweet_count, favorite_count, entities, favorited, retweeted,
+    lang)
+
+// Always null
+template <>
+struct structread::key_handlers<Status> {
+    using Ignore = structread::key_handler_ignore<Status>;
+    static constexpr auto handlers = std::make_tuple(structread::key_handler("geo", Ignore {}),
+        structread::key_handler("coordinates", Ignore {}),
+        structread::key_handler("place", Ignore {}));
+};
+
+struct SearchMetadata {
+    double completed_in;
+    uint64_t max_id;
+    std::string query;
+    uint32_t count;
+};
+MJ2_TYPE_META(SearchMetadata, completed_in, max_id, query, count)
+
+struct Twitter {
+    std::vector<Status> statuses;
+    SearchMetadata search_metadata;
+};
+MJ2_TYPE_META(Twitter, statuses, search_metadata)
+
+struct CanadaProperties {
+    std::string name;
+};
+MJ2_TYPE_META(CanadaProperties, name)
+
+struct CanadaGeometry {
+    std::string type;
+    std::vector<std::vector<std::array<double, 2>>> coordinates;
+};
+MJ2_TYPE_META(CanadaGeometry, type, coordinates)
+
+struct CanadaFeature {
+    std::string type;
+    CanadaProperties properties;
+    CanadaGeometry geometry;
+};
+MJ2_TYPE_META(CanadaFeature, type, properties, geometry)
+
+struct Canada {
+    std::string type;
+    std::vector<CanadaFeature> features;
+};
+MJ2_TYPE_META(Canada, type, features)
+
+struct CitmPrice {
+    uint32_t amount;
+    uint64_t audienceSubCategoryId;
+    uint64_t seatCategoryId;
+};
+MJ2_TYPE_META(CitmPrice, amount, audienceSubCategoryId, seatCategoryId)
+
+struct CitmArea {
+    uint64_t areaId;
+    std::vector<uint64_t> blockIds;
+};
+MJ2_TYPE_META(CitmArea, areaId, blockIds)
+
+struct CitmSeatCategory {
+    std::vector<CitmArea> areas;
+    uint64_t seatCategoryId;
+};
+MJ2_TYPE_META(CitmSeatCategory, areas, seatCategoryId)
+
+struct CitmPerformance {
+    uint64_t eventId;
+    uint64_t id;
+    std::vector<CitmPrice> prices;
+    std::vector<CitmSeatCategory> seatCategories;
+    uint64_t start;
+    std::string venueCode;
+};
+MJ2_TYPE_META(CitmPerformance, eventId, id, prices, seatCategories, start, venueCode)
+
+template <>
+struct structread::key_handlers<CitmPerformance> {
+    using Ignore = structread::key_handler_ignore<CitmPerformance>;
+    static constexpr auto handlers = std::make_tuple(structread::key_handler("logo", Ignore {}),
+        structread::key_handler("name", Ignore {}),
+        structread::key_handler("seatMapImage", Ignore {}));
+};
+
+struct Citm {
+    std::vector<CitmPerformance> performances;
+};
+MJ2_TYPE_META(Citm, performances)
+
+// The id maps can't be read into structs
+template <>
+struct structread::key_handlers<Citm> {
+    using Ignore = structread::key_handler_ignore<Citm>;
+    static constexpr auto handlers = std::make_tuple(
+        structread::key_handler("areaNames", Ignore {}),
+        structread::key_handler("events", Ignore {}));
+};
+
+struct LogEntry {
+    uint64_t ts;
+    std::string level;
+    std::string service;
+    std::string msg;
+    double latency_ms;
+    uint16_t status;
+    std::vector<std::string> tags;
+    std::optional<std::string> user;
+};
+MJ2_TYPE_META(LogEntry, ts, level, service, msg, latency_ms, status, tags, user)
+
+struct Options {
+    ParseOptions parse_options;
+    size_t num_threads = 1;
+    double min_time_ms = 500.0;
+    std::string filter;
+    bool json = false;
+    std::vector<std::string> files;
+};
+
+volatile size_t consume_sink = 0;
+
+// Reads all tokens and parses all values, like a real consumer would
+bool consume_all(Parser& parser)
+{
+    size_t sink = 0;
+    auto token = parser.next();
+    while (token.type() != Token::Type::Eof) {
+        switch (token.type()) {
+        case Token::Type::Error:
+            return false;
+        case Token::Type::String:
+            sink += parser.parse_string(token).size();
+            break;
+        case Token::Type::Int:
+            sink += parser.parse_int(token) == 0;
+            break;
+        case Token::Type::UInt:
+            sink += parser.parse_uint(token) == 0;
+            break;
+        case Token::Type::Float:
+            sink += parser.parse_float(token) == 0.0;
+            break;
+        case Token::Type::Bool:
+            sink += parser.parse_bool(token);
+            break;
+        default:
+            break;
+        }
+        token = parser.next();
+    }
+    // Keep the work from being optimized out
+    consume_sink = sink;
+    return true;
+}
+
+size_t count_tokens(Parser& parser)
+{
+    size_t num_tokens = 0;
+    while (true) {
+        const auto token = parser.next();
+        if (token.type() == Token::Type::Eof || token.type() == Token::Type::Error) {
+            return num_tokens;
+        }
+        num_tokens++;
+    }
+}
+
+struct Corpus {
+    std::string name;
+    std::string data;
+    bool ndjson = false;
+    size_t num_tokens = 0;
+};
+
+struct Result {
+    std::string corpus;
+    std::string path;
+    size_t bytes;
+    size_t tokens;
+    size_t iterations;
+    // The median
+    double ns_per_parse;
+    double allocations_per_parse;
+};
+
+class Runner {
+public:
+    Runner(const Options& options) : options_(options) { }
+
+    // func gets a fresh copy of the input for every iteration (it is escaped in-place) and returns
+    // whether parsing succeeded
+    template <typename Func>
+    void run(const Corpus& corpus, std::string_view path, Func&& func)
+    {
+        const auto name = corpus.name + "/" + std::string(path);
+        if (!options_.filter.empty() && name.find(options_.filter) == std::string::npos) {
+            return;
+        }
+
+        // The buffer is large enough after the first copy, so the copy does not allocate
+        std::string buffer = corpus.data;
+        if (!func(buffer)) {
+            std::cerr << name << ": Parsing failed" << std::endl;
+            std::exit(1);
+        }
+
+        using Clock = std::chrono::steady_clock;
+        const auto min_time = std::chrono::duration<double, std::milli>(options_.min_time_ms);
+        constexpr size_t min_iterations = 5;
+        std::vector<double> times;
+        times.reserve(1024);
+        size_t allocations = 0;
+        const auto start = Clock::now();
+        while (times.size() < min_iterations
+            || (Clock::now() - start < min_time && times.size() < times.capacity())) {
+            buffer.assign(corpus.data);
+            const auto allocations_before = num_allocations.load(std::memory_order_relaxed);
+            const auto parse_start = Clock::now();
+            const auto ok = func(buffer);
+            const auto parse_end = Clock::now();
+            allocations += num_allocations.load(std::memory_order_relaxed) - allocations_before;
+            if (!ok) {
+                std::cerr << name << ": Parsing failed" << std::endl;
+                std::exit(1);
+            }
+            const auto time = std::chrono::duration<double, std::nano>(parse_end - parse_start);
+            times.push_back(time.count());
+        }
+        std::sort(times.begin(), times.end());
+
+        results_.push_back(Result {
+            .corpus = corpus.name,
+            .path = std::string(path),
+            .bytes = corpus.data.size(),
+            .tokens = corpus.num_tokens,
+            .iterations = times.size(),
+            .ns_per_parse = times[times.size() / 2],
+            .allocations_per_parse
+            = static_cast<double>(allocations) / static_cast<double>(times.size()),
+        });
+        if (!options_.json) {
+            print(results_.back());
+        }
+    }
+
+    const std::vector<Result>& results() const { return results_; }
+
+    static void print_header()
+    {
+        std::printf("%-24s %10s %12s %8s %10s %14s\n", "benchmark", "size", "ms/parse", "GB/s",
+            "ns/token", "allocs/parse");
+    }
+
+    static void print(const Result& r)
+    {
+        const auto name = r.corpus + "/" + r.path;
+        std::printf("%-24s %7.1f KB %12.3f %8.3f %10.2f %14.1f\n", name.c_str(),
+            static_cast<double>(r.bytes) / 1024.0, r.ns_per_parse / 1e6,
+            static_cast<double>(r.bytes) / r.ns_per_parse,
+            r.ns_per_parse / static_cast<double>(r.tokens), r.allocations_per_parse);
+    }
+
+private:
+    const Options& options_;
+    std::vector<Result> results_;
+};
+
+// A few fields out of each document, like a request router would read them
+using OnDemandLookup = bool (*)(ondemand::Document& doc);
+
+OnDemandLookup get_ondemand_lookup(std::string_view corpus)
+{
+    if (corpus == "twitter") {
+        return [](ondemand::Document& doc) {
+            const auto root = doc.root();
+            return root["statuses"][0]["user"]["id"].get_uint()
+                && root["search_metadata"]["count"].get_uint();
+        };
+    } else if (corpus == "canada") {
+        return [](ondemand::Document& doc) {
+            return doc.root()["features"][0]["properties"]["name"].get_string().has_value();
+        };
+    } else if (corpus == "citm") {
+        return [](ondemand::Document& doc) {
+            return doc.root()["performances"][0]["id"].get_uint().has_value();
+        };
+    } else if (corpus == "gltf") {
+        return [](ondemand::Document& doc) {
+            const auto root = doc.root();
+            return root["asset"]["version"].get_string()
+                && root["buffers"][0]["byteLength"].get_uint();
+        };
+    }
+    return nullptr;
+}
+
+template <typename T>
+void run_document_benchmarks(Runner& runner, const Corpus& corpus, const Options& options)
+{
+    const auto parse_options = options.parse_options;
+    runner.run(corpus, "sax", [&](std::string& input) {
+        Parser parser(input, parse_options);
+        return consume_all(parser);
+    });
+    runner.run(corpus, "skip", [&](std::string& input) {
+        Parser parser(input, parse_options);
+        return parser.skip(parser.next());
+    });
+    auto strict_options = parse_options;
+    strict_options.skip_mode = SkipMode::Strict;
+    runner.run(corpus, "skip-strict", [&](std::string& input) {
+        Parser parser(input, strict_options);
+        return parser.skip(parser.next());
+    });
+    // Reused, like the documentation recommends
+    Document doc;
+    runner.run(corpus, "dom", [&](std::string& input) {
+        Parser parser(input, parse_options);
+        return doc.parse(parser);
+    });
+    // What is left of the startup cost if the document has been saved before
+    std::string saved;
+    {
+        std::string input = corpus.data;
+        Parser parser(input, parse_options);
+        if (doc.parse(parser)) {
+            doc.serialize(saved);
+        }
+    }
+    runner.run(corpus, "dom-load", [&](std::string&) { return doc.load(saved); });
+    // Changing a single digit in the middle of the document, like an editor would
+    std::string edited = corpus.data;
+    const auto digit = edited.find_first_of("12345678", edited.size() / 2);
+    if (digit != std::string::npos) {
+        const auto original = edited[digit];
+        std::string scratch;
+        Document editable;
+        editable.parse_editable(edited, scratch, parse_options);
+        runner.run(corpus, "dom-reparse", [&](std::string&) {
+            edited[digit] = edited[digit] == original ? original + 1 : original;
+            return editable.reparse(edited, digit, 1, scratch, parse_options);
+        });
+    }
+    if (const auto lookup = get_ondemand_lookup(corpus.name)) {
+        runner.run(corpus, "ondemand", [&](std::string& input) {
+            ondemand::Document doc(input, parse_options);
+            return lookup(doc);
+        });
+    }
+    if constexpr (!std::is_void_v<T>) {
+        runner.run(corpus, "structread", [&](std::string& input) {
+            structread::ParseContext ctx(input, parse_options);
+            T value;
+            return structread::from_json(value, ctx);
+        });
+    }
+}
+
+void run_ndjson_benchmarks(Runner& runner, const Corpus& corpus, const Options& options)
+{
+    NdjsonOptions ndjson_options;
+    ndjson_options.num_threads = options.num_threads;
+    ndjson_options.parse_options = options.parse_options;
+    NdjsonParser ndjson(ndjson_options);
+    runner.run(corpus, "sax", [&](std::string& input) {
+        return ndjson.parse(input, true, [](Parser& parser, size_t, size_t) {
+            return consume_all(parser);
+        }).ok;
+    });
+    // Filtering records by a path without looking at the rest
+    const auto query = *Query::path("$.tags[*]");
+    // One per thread, so they don't allocate for every line
+    std::vector<Query::Matcher> matchers(ndjson.num_threads(), Query::Matcher(query));
+    runner.run(corpus, "query", [&](std::string& input) {
+        std::atomic<size_t> num_matches = 0;
+        return ndjson.parse(input, true, [&](Parser& parser, size_t, size_t thread) {
+            auto& matcher = matchers[thread];
+            matcher.reset(parser);
+            auto token = matcher.next();
+            while (token) {
+                num_matches++;
+                token = matcher.next();
+            }
+            return token.type() != Token::Type::Error;
+        }).ok;
+    });
+    runner.run(corpus, "structread", [&](std::string& input) {
+        std::vector<LogEntry> entries;
+        std::optional<structread::ParseContext::Error> error;
+        return structread::from_ndjson(ndjson, entries, input, true, error).ok;
+    });
+}
+
+std::optional<std::string> read_file(const std::string& path)
+{
+    FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) {
+        return std::nullopt;
+    }
+    std::fseek(f, 0, SEEK_END);
+    const auto size = std::ftell(f);
+    if (size < 0) {
+        std::fclose(f);
+        return std::nullopt;
+    }
+    std::fseek(f, 0, SEEK_SET);
+    std::string data(static_cast<size_t>(size), '\0');
+    const auto read = std::fread(data.data(), 1, data.size(), f);
+    std::fclose(f);
+    if (read != data.size()) {
+        return std::nullopt;
+    }
+    return data;
+}
+
+std::optional<Options> parse_args(int argc, char** argv)
+{
+    const std::vector<std::string> args(argv + 1, argv + argc);
+    Options options;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "--json") {
+            options.json = true;
+        } else if (args[i] == "--indexed") {
+            options.parse_options.mode = ParseMode::Indexed;
+        } else if (args[i] == "--validate-utf8") {
+            options.parse_options.validate_utf8 = true;
+        } else if (args[i] == "--filter") {
+            if (i + 1 >= args.size()) {
+                std::cerr << "Missing substring for --filter" << std::endl;
+                return std::nullopt;
+            }
+            options.filter = args[++i];
+        } else if (args[i] == "--min-time") {
+            if (i + 1 >= args.size()) {
+                std::cerr << "Missing milliseconds for --min-time" << std::endl;
+                return std::nullopt;
+            }
+            options.min_time_ms = std::stod(args[++i]);
+        } else if (args[i] == "--threads") {
+            if (i + 1 >= args.size()) {
+                std::cerr << "Missing number of threads for --threads" << std::endl;
+                return std::nullopt;
+            }
+            options.num_threads = std::stoul(args[++i]);
+        } else if (args[i].starts_with("--")) {
+            std::cerr << "Unknown flag '" << args[i] << "'" << std::endl;
+            return std::nullopt;
+        } else {
+            options.files.push_back(args[i]);
+        }
+    }
+    return options;
+}
+
+int main(int argc, char** argv)
+{
+    const auto options = parse_args(argc, argv);
+    if (!options) {
+        std::cerr << "Usage: minijson2-bench [--json] [--filter <substring>] [--min-time <ms>] "
+                     "[--threads <n>] [--indexed] [--validate-utf8] [<file>...]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::vector<Corpus> corpora;
+    corpora.push_back({ .name = "twitter", .data = generate_twitter() });
+    corpora.push_back({ .name = "canada", .data = generate_canada() });
+    corpora.push_back({ .name = "citm", .data = generate_citm() });
+    if (auto gltf = read_file(MINIJSON2_TEST_DIR "/ac_ship.json")) {
+        corpora.push_back({ .name = "gltf", .data = std::move(*gltf) });
+    } else {
+        std::cerr << "Could not read " MINIJSON2_TEST_DIR "/ac_ship.json, skipping glTF"
+                  << std::endl;
+    }
+    corpora.push_back({ .name = "logs", .data = generate_logs(), .ndjson = true });
+    for (const auto& path : options->files) {
+        auto data = read_file(path);
+        if (!data) {
+            std::cerr << "Could not read file '" << path << "'" << std::endl;
+            return 1;
+        }
+        corpora.push_back({ .name = path, .data = std::move(*data) });
+    }
+
+    for (auto& corpus : corpora) {
+        auto copy = corpus.data;
+        if (corpus.ndjson) {
+            NdjsonOptions ndjson_options;
+            ndjson_options.num_threads = 1;
+            NdjsonParser ndjson(ndjson_options);
+            std::atomic<size_t> num_tokens = 0;
+            ndjson.parse(copy, true, [&num_tokens](Parser& parser, size_t, size_t) {
+                num_tokens += count_tokens(parser);
+                return true;
+            });
+            corpus.num_tokens = num_tokens;
+        } else {
+            Parser parser(copy);
+            corpus.num_tokens = count_tokens(parser);
+        }
+    }
+
+    Runner runner(*options);
+    if (!options->json) {
+        Runner::print_header();
+    }
+    for (const auto& corpus : corpora) {
+        if (corpus.name == "twitter") {
+            run_document_benchmarks<Twitter>(runner, corpus, *options);
+        } else if (corpus.name == "canada") {
+            run_document_benchmarks<Canada>(runner, corpus, *options);
+        } else if (corpus.name == "citm") {
+            run_document_benchmarks<Citm>(runner, corpus, *options);
+        } else if (corpus.ndjson) {
+            run_ndjson_benchmarks(runner, corpus, *options);
+        } else {
+            run_document_benchmarks<void>(runner, corpus, *options);
+        }
+    }
+
+    if (options->json) {
+        // For regression tracking
+        Writer w({ .pretty = true });
+        w.begin_object();
+        w.key("mode");
+        w.value(options->parse_options.mode == ParseMode::Indexed ? "indexed" : "default");
+        w.key("validate_utf8");
+        w.value(options->parse_options.validate_utf8);
+        w.key("threads");
+        w.value(options->num_threads);
+        w.key("results");
+        w.begin_array();
+        for (const auto& r : runner.results()) {
+            w.begin_object();
+            w.key("corpus");
+            w.value(r.corpus);
+            w.key("path");
+            w.value(r.path);
+            w.key("bytes");
+            w.value(r.bytes);
+            w.key("tokens");
+            w.value(r.tokens);
+            w.key("iterations");
+            w.value(r.iterations);
+            w.key("ns_per_parse");
+            w.value(r.ns_per_parse);
+            w.key("gb_per_s");
+            w.value(static_cast<double>(r.bytes) / r.ns_per_parse);
+            w.key("ns_per_token");
+            w.value(r.ns_per_parse / static_cast<double>(r.tokens));
+            w.key("allocations_per_parse");
+            w.value(r.allocations_per_parse);
+            w.end_object();
+        }
+        w.end_array();
+        w.end_object();
+        std::cout << w.output() << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,797 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <minijson2/document.hpp>
+#include <minijson2/minijson2.hpp>
+#include <minijson2/parallel.hpp>
+#include <minijson2/writer.hpp>
+
+#include "simd.hpp"
+
+using namespace minijson2;
+
+// Differential fuzzing of all the ways to tokenize a document: Every kernel level (scalar, SSE2,
+// AVX2, NEON), both parse modes, read-only parsers and StreamParser with random chunk boundaries
+// have to produce exactly the same tokens, values and errors as the scalar Parser. The inputs are
+// generated, the fixtures in test/ and files from the command line, all of them randomly mutated.
+// Afterwards the throughput of every engine is measured on the unmutated inputs and optionally
+// compared to a saved baseline. Divergences and regressions make the run fail.
+
+// splitmix64, like in minijson2-bench, so runs are reproducible everywhere with the same seed
+class Random {
+public:
+    explicit Random(uint64_t seed) : state_(seed) { }
+
+    uint64_t next()
+    {
+        state_ += 0x9E37'79B9'7F4A'7C15;
+        auto z = state_;
+        z = (z ^ (z >> 30)) * 0xBF58'476D'1CE4'E5B9;
+        z = (z ^ (z >> 27)) * 0x94D0'49BB'1331'11EB;
+        return z ^ (z >> 31);
+    }
+
+    // [0, n)
+    uint64_t below(uint64_t n) { return next() % n; }
+
+    bool chance(double p) { return static_cast<double>(next() >> 11) < p * (1ull << 53); }
+
+    template <typename T>
+    const T& pick(const std::vector<T>& values)
+    {
+        return values[below(values.size())];
+    }
+
+private:
+    uint64_t state_;
+};
+
+// Generates mostly valid JSON, with all the things that are hard for the kernels: strings that
+// cross block boundaries, escapes at every position, multi-byte UTF-8 (valid or not), long runs of
+// whitespace and deep nesting.
+class Generator {
+public:
+    explicit Generator(Random& rng) : rng_(rng) { }
+
+    std::string document()
+    {
+        out_.clear();
+        whitespace();
+        // Deeper than the inline container stack of the parser now and then
+        const auto nesting = rng_.chance(0.05) ? 100 + rng_.below(200) : 0;
+        std::string closing;
+        for (size_t i = 0; i < nesting; ++i) {
+            const auto object = rng_.chance(0.5);
+            out_.append(object ? "{\"k\":" : "[");
+            closing.push_back(object ? '}' : ']');
+        }
+        value(6);
+        out_.append(closing.rbegin(), closing.rend());
+        whitespace();
+        return out_;
+    }
+
+private:
+    void whitespace()
+    {
+        static const std::vector<std::string> runs
+            = { "", "", "", " ", "\n", "\r\n", "\t", "  ", std::string(40, ' '), "\n    " };
+        out_.append(rng_.pick(runs));
+    }
+
+    void value(size_t depth)
+    {
+        const auto kind = rng_.below(depth > 0 ? 8 : 5);
+        switch (kind) {
+        case 0:
+            out_.append(rng_.pick(std::vector<std::string> { "null", "true", "false" }));
+            break;
+        case 1:
+        case 2:
+            number();
+            break;
+        case 3:
+        case 4:
+            string();
+            break;
+        case 5:
+        case 6:
+            array(depth - 1);
+            break;
+        default:
+            object(depth - 1);
+            break;
+        }
+    }
+
+    void number()
+    {
+        static const std::vector<std::string> special = { "0", "-0", "0.0", "1e400", "-1e-400",
+            "18446744073709551615", "18446744073709551616", "-9223372036854775808",
+            "-9223372036854775809", "0.1", "1E+2", "123456789012345678901234567890" };
+        if (rng_.chance(0.2)) {
+            out_.append(rng_.pick(special));
+            return;
+        }
+        if (rng_.chance(0.3)) {
+            out_.push_back('-');
+        }
+        const auto digits = 1 + rng_.below(rng_.chance(0.1) ? 25 : 6);
+        out_.push_back(static_cast<char>('1' + rng_.below(9)));
+        for (size_t i = 1; i < digits; ++i) {
+            out_.push_back(static_cast<char>('0' + rng_.below(10)));
+        }
+        if (rng_.chance(0.3)) {
+            out_.push_back('.');
+            for (size_t i = 1 + rng_.below(8); i > 0; --i) {
+                out_.push_back(static_cast<char>('0' + rng_.below(10)));
+            }
+        }
+        if (rng_.chance(0.15)) {
+            out_.append(rng_.pick(std::vector<std::string> { "e", "E", "e-", "E+" }));
+            out_.append(std::to_string(rng_.below(330)));
+        }
+    }
+
+    void string()
+    {
+        static const std::vector<std::string> pieces = { "\\\"", "\\\\", "\\/", "\\b", "\\f",
+            "\\n", "\\r", "\\t", "\\u0041", "\\u00e9", "\\u20AC", "\\uD83D\\uDE00", "\\uD83D",
+            "\\uDE00x", "\\u0000", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80", "\xed\x9f\xbf",
+            "\xef\xbf\xbf", "\xf4\x8f\xbf\xbf" };
+        static const std::vector<std::string> invalid = { "\x80", "\xc0\x80", "\xc3", "\xe2\x82",
+            "\xed\xa0\x80", "\xf4\x90\x80\x80", "\xf8\x88\x80\x80\x80", "\xff", "\x01", "\x1f" };
+        out_.push_back('"');
+        const auto parts = rng_.below(rng_.chance(0.2) ? 12 : 4);
+        for (size_t i = 0; i < parts; ++i) {
+            if (rng_.chance(0.5)) {
+                // Lengths around the block sizes of the kernels
+                const auto length = rng_.below(rng_.chance(0.3) ? 140 : 20);
+                for (size_t j = 0; j < length; ++j) {
+                    out_.push_back(static_cast<char>('a' + rng_.below(26)));
+                }
+            } else {
+                out_.append(rng_.chance(0.05) ? rng_.pick(invalid) : rng_.pick(pieces));
+            }
+        }
+        out_.push_back('"');
+    }
+
+    void array(size_t depth)
+    {
+        out_.push_back('[');
+        whitespace();
+        const auto size = rng_.below(depth > 10 ? 2 : 6);
+        for (size_t i = 0; i < size; ++i) {
+            if (i > 0) {
+                out_.push_back(',');
+                whitespace();
+            }
+            value(depth);
+            whitespace();
+        }
+        out_.push_back(']');
+    }
+
+    void object(size_t depth)
+    {
+        out_.push_back('{');
+        whitespace();
+        const auto size = rng_.below(depth > 10 ? 2 : 6);
+        for (size_t i = 0; i < size; ++i) {
+            if (i > 0) {
+                out_.push_back(',');
+                whitespace();
+            }
+            string();
+            whitespace();
+            out_.push_back(':');
+            whitespace();
+            value(depth);
+            whitespace();
+        }
+        out_.push_back('}');
+    }
+
+    Random& rng_;
+    std::string out_;
+};
+
+// Small edits that mostly produce almost valid JSON, so the error paths are exercised everywhere
+void mutate(std::string& input, Random& rng)
+{
+    static const std::string dictionary = "\"\\{}[],: \n\t0123456789-+.eEtrufalsn\x80\xc3\xed\xff";
+    for (auto n = rng.below(4); n > 0 && !input.empty(); --n) {
+        const auto pos = rng.below(input.size());
+        switch (rng.below(5)) {
+        case 0:
+            input[pos] = dictionary[rng.below(dictionary.size())];
+            break;
+        case 1:
+            input.insert(input.begin() + static_cast<ptrdiff_t>(pos),
+                dictionary[rng.below(dictionary.size())]);
+            break;
+        case 2:
+            input.erase(pos, 1 + rng.below(8));
+            break;
+        case 3: {
+            const auto length = std::min<size_t>(1 + rng.below(32), input.size() - pos);
+            input.insert(pos, input.substr(pos, length));
+            break;
+        }
+        default:
+            input.resize(pos);
+            break;
+        }
+    }
+}
+
+struct Engine {
+    enum class Kind {
+        Parser,
+        ReadOnly,
+        Stream,
+    };
+
+    std::string name;
+    simd::Level level;
+    Kind kind;
+    ParseMode mode;
+};
+
+const char* level_name(simd::Level level)
+{
+    switch (level) {
+    case simd::Level::Scalar:
+        return "scalar";
+    case simd::Level::Sse2:
+        return "sse2";
+    case simd::Level::Avx2:
+        return "avx2";
+    case simd::Level::Neon:
+        return "neon";
+    }
+    return "?";
+}
+
+// The first engine is the reference
+std::vector<Engine> get_engines()
+{
+    std::vector<Engine> engines;
+    for (const auto level :
+        { simd::Level::Scalar, simd::Level::Sse2, simd::Level::Avx2, simd::Level::Neon }) {
+        if (!simd::is_level_supported(level)) {
+            continue;
+        }
+        const std::string name = level_name(level);
+        engines.push_back({ name, level, Engine::Kind::Parser, ParseMode::Default });
+        engines.push_back({ name + "/indexed", level, Engine::Kind::Parser, ParseMode::Indexed });
+        engines.push_back(
+            { name + "/read-only", level, Engine::Kind::ReadOnly, ParseMode::Default });
+        engines.push_back({ name + "/stream", level, Engine::Kind::Stream, ParseMode::Default });
+    }
+    return engines;
+}
+
+// Control characters and non-ASCII bytes as \xNN, so traces are one line per token
+void append_printable(std::string& out, std::string_view str)
+{
+    static const char* hex = "0123456789abcdef";
+    for (const auto ch : str) {
+        const auto byte = static_cast<unsigned char>(ch);
+        if (byte < 0x20 || byte >= 0x7F || ch == '\\') {
+            out.append("\\x");
+            out.push_back(hex[byte >> 4]);
+            out.push_back(hex[byte & 0xF]);
+        } else {
+            out.push_back(ch);
+        }
+    }
+}
+
+// Everything about a token that a user of the parser can observe
+template <typename P>
+void append_token(std::string& trace, P& parser, const Token& token)
+{
+    if (token.type() == Token::Type::Error) {
+        trace.append("error " + std::to_string(token.error_location()) + " ");
+        trace.append(token.error_message());
+        trace.push_back('\n');
+        return;
+    }
+    if (token.type() == Token::Type::Eof) {
+        // The string of the Eof token is the rest of the input, which StreamParser doesn't have
+        trace.append("eof\n");
+        return;
+    }
+    trace.append(std::to_string(static_cast<int>(token.type())) + " "
+        + std::to_string(parser.get_location(token)) + " ");
+    switch (token.type()) {
+    case Token::Type::String:
+        append_printable(trace, parser.parse_string(token));
+        break;
+    case Token::Type::Int:
+        trace.append(std::to_string(parser.parse_int(token)));
+        break;
+    case Token::Type::UInt:
+        trace.append(std::to_string(parser.parse_uint(token)));
+        break;
+    case Token::Type::Float: {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.17g", parser.parse_float(token));
+        trace.append(buf);
+        break;
+    }
+    case Token::Type::Bool:
+        trace.append(parser.parse_bool(token) ? "true" : "false");
+        break;
+    default:
+        append_printable(trace, token.string());
+        break;
+    }
+    trace.push_back('\n');
+}
+
+// Every input terminates after at most one token per byte (plus Eof), so anything longer is a bug
+bool runaway(size_t num_tokens, std::string_view input)
+{
+    return num_tokens > input.size() + 2;
+}
+
+std::string parser_trace(Parser& parser)
+{
+    std::string trace;
+    size_t num_tokens = 0;
+    while (true) {
+        const auto token = parser.next();
+        append_token(trace, parser, token);
+        if (token.type() == Token::Type::Eof || token.type() == Token::Type::Error) {
+            return trace;
+        }
+        if (runaway(++num_tokens, parser.input())) {
+            return trace + "runaway\n";
+        }
+    }
+}
+
+std::string stream_trace(std::string_view input, ParseOptions options, Random& chunk_rng)
+{
+    StreamParser parser(false, options);
+    std::string trace;
+    size_t fed = 0;
+    size_t num_tokens = 0;
+    while (true) {
+        const auto token = parser.next();
+        if (token.type() == Token::Type::NeedInput) {
+            if (fed < input.size()) {
+                const auto chunk_size = chunk_rng.chance(0.1) ? 1 + chunk_rng.below(4096)
+                                                              : 1 + chunk_rng.below(70);
+                const auto chunk = input.substr(fed, chunk_size);
+                parser.feed(chunk);
+                fed += chunk.size();
+            } else {
+                parser.finish();
+            }
+            continue;
+        }
+        append_token(trace, parser, token);
+        if (token.type() == Token::Type::Eof || token.type() == Token::Type::Error) {
+            return trace;
+        }
+        if (runaway(++num_tokens, input)) {
+            return trace + "runaway\n";
+        }
+    }
+}
+
+std::string trace(const Engine& engine, std::string_view input, ParseOptions options,
+    uint64_t chunk_seed)
+{
+    simd::use_level(engine.level);
+    options.mode = engine.mode;
+    switch (engine.kind) {
+    case Engine::Kind::Parser: {
+        std::string copy(input);
+        Parser parser(copy, options);
+        return parser_trace(parser);
+    }
+    case Engine::Kind::ReadOnly: {
+        std::string scratch;
+        Parser parser(input, scratch, options);
+        return parser_trace(parser);
+    }
+    case Engine::Kind::Stream: {
+        Random chunk_rng(chunk_seed);
+        return stream_trace(input, options, chunk_rng);
+    }
+    }
+    return {};
+}
+
+// Like full_parse in minijson2-test: all values are parsed, but nothing is recorded
+template <typename P>
+size_t consume(P& parser)
+{
+    size_t v = 0;
+    while (true) {
+        const auto token = parser.next();
+        switch (token.type()) {
+        case Token::Type::String:
+            v += parser.parse_string(token).size();
+            break;
+        case Token::Type::Int:
+            v += parser.parse_int(token) == 0;
+            break;
+        case Token::Type::UInt:
+            v += parser.parse_uint(token) == 0;
+            break;
+        case Token::Type::Float:
+            v += parser.parse_float(token) == 0.0;
+            break;
+        case Token::Type::Bool:
+            v += parser.parse_bool(token);
+            break;
+        case Token::Type::NeedInput:
+            return v; // The whole input is fed at once, so this does not happen
+        case Token::Type::Eof:
+        case Token::Type::Error:
+            return v;
+        default:
+            break;
+        }
+    }
+}
+
+size_t consume(const Engine& engine, std::string_view input, std::string& scratch)
+{
+    ParseOptions options;
+    options.mode = engine.mode;
+    switch (engine.kind) {
+    case Engine::Kind::Parser: {
+        std::string copy(input);
+        Parser parser(copy, options);
+        return consume(parser);
+    }
+    case Engine::Kind::ReadOnly: {
+        Parser parser(input, scratch, options);
+        return consume(parser);
+    }
+    case Engine::Kind::Stream: {
+        StreamParser parser(false, options);
+        parser.feed(input);
+        parser.finish();
+        return consume(parser);
+    }
+    }
+    return 0;
+}
+
+// MB/s over all inputs, the best of a few repetitions each. The mutable engines copy the input,
+// which is part of what they cost anyway, and the read-only one is measured in the same way.
+double measure(const Engine& engine, const std::vector<std::string>& inputs, size_t repetitions)
+{
+    simd::use_level(engine.level);
+    std::string scratch;
+    size_t sink = 0;
+    double total_seconds = 0.0;
+    size_t total_bytes = 0;
+    for (const auto& input : inputs) {
+        auto best = std::numeric_limits<double>::max();
+        for (size_t i = 0; i < repetitions; ++i) {
+            const auto start = std::chrono::steady_clock::now();
+            sink += consume(engine, input, scratch);
+            const auto end = std::chrono::steady_clock::now();
+            best = std::min(best, std::chrono::duration<double>(end - start).count());
+        }
+        total_seconds += best;
+        total_bytes += input.size();
+    }
+    // Keep the work from being optimized out
+    if (sink == 0x5EED) {
+        std::cout << "";
+    }
+    return static_cast<double>(total_bytes) / 1e6 / total_seconds;
+}
+
+std::optional<std::string> read_file(const std::string& path)
+{
+    FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) {
+        return std::nullopt;
+    }
+    std::fseek(f, 0, SEEK_END);
+    const auto size = std::ftell(f);
+    if (size < 0) {
+        std::fclose(f);
+        return std::nullopt;
+    }
+    std::fseek(f, 0, SEEK_SET);
+    std::string data(static_cast<size_t>(size), '\0');
+    const auto read = std::fread(data.data(), 1, data.size(), f);
+    std::fclose(f);
+    if (read != data.size()) {
+        return std::nullopt;
+    }
+    return data;
+}
+
+bool write_file(const std::string& path, std::string_view data)
+{
+    FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    const auto written = std::fwrite(data.data(), 1, data.size(), f);
+    return std::fclose(f) == 0 && written == data.size();
+}
+
+struct Options {
+    size_t iterations = 2000;
+    uint64_t seed = 1;
+    size_t repetitions = 5;
+    bool perf = true;
+    // Relative slowdown compared to the baseline that counts as a regression
+    double tolerance = 0.15;
+    std::optional<std::string> baseline;
+    std::optional<std::string> save_baseline;
+    std::vector<std::string> files;
+};
+
+std::optional<Options> parse_args(int argc, char** argv)
+{
+    Options options;
+    const std::vector<std::string> args(argv + 1, argv + argc);
+    for (size_t i = 0; i < args.size(); ++i) {
+        const auto has_value = i + 1 < args.size();
+        if (args[i] == "--iterations" && has_value) {
+            options.iterations = std::stoull(args[++i]);
+        } else if (args[i] == "--seed" && has_value) {
+            options.seed = std::stoull(args[++i]);
+        } else if (args[i] == "--repetitions" && has_value) {
+            options.repetitions = std::max<size_t>(1, std::stoull(args[++i]));
+        } else if (args[i] == "--tolerance" && has_value) {
+            options.tolerance = std::stod(args[++i]) / 100.0;
+        } else if (args[i] == "--baseline" && has_value) {
+            options.baseline = args[++i];
+        } else if (args[i] == "--save-baseline" && has_value) {
+            options.save_baseline = args[++i];
+        } else if (args[i] == "--no-perf") {
+            options.perf = false;
+        } else if (args[i].starts_with("--")) {
+            return std::nullopt;
+        } else {
+            options.files.push_back(args[i]);
+        }
+    }
+    return options;
+}
+
+// Returns the first line in which the traces differ, for both of them
+std::pair<std::string_view, std::string_view> first_difference(
+    std::string_view a, std::string_view b)
+{
+    size_t line_start = 0;
+    for (size_t i = 0; i < std::min(a.size(), b.size()) && a[i] == b[i]; ++i) {
+        if (a[i] == '\n') {
+            line_start = i + 1;
+        }
+    }
+    const auto line = [line_start](std::string_view trace) {
+        const auto rest = trace.substr(std::min(line_start, trace.size()));
+        return rest.substr(0, rest.find('\n'));
+    };
+    return { line(a), line(b) };
+}
+
+// Returns the number of divergences
+size_t fuzz(const Options& options, const std::vector<Engine>& engines,
+    const std::vector<std::string>& seeds)
+{
+    Random rng(options.seed);
+    Generator generator(rng);
+    size_t divergences = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t it = 0; it < options.iterations; ++it) {
+        auto input = !seeds.empty() && rng.chance(0.1) ? rng.pick(seeds) : generator.document();
+        mutate(input, rng);
+        const auto chunk_seed = rng.next();
+        for (const auto validate_utf8 : { false, true }) {
+            const ParseOptions parse_options { .validate_utf8 = validate_utf8 };
+            const auto reference = trace(engines[0], input, parse_options, chunk_seed);
+            for (size_t e = 1; e < engines.size(); ++e) {
+                const auto result = trace(engines[e], input, parse_options, chunk_seed);
+                if (result == reference) {
+                    continue;
+                }
+                divergences++;
+                const auto path = "minijson2-fuzz-" + std::to_string(options.seed) + "-"
+                    + std::to_string(it) + ".json";
+                const auto [expected, actual] = first_difference(reference, result);
+                std::cerr << "Divergence in iteration " << it << " (" << engines[e].name
+                          << (validate_utf8 ? ", validate_utf8" : "") << "), input written to "
+                          << path << "\n  " << engines[0].name << ": " << expected << "\n  "
+                          << engines[e].name << ": " << actual << std::endl;
+                write_file(path, input);
+                break;
+            }
+        }
+    }
+    simd::use_level(simd::best_level());
+    const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+    std::cout << options.iterations << " inputs through " << engines.size() << " engines in "
+              << seconds.count() << "s, " << divergences << " divergences" << std::endl;
+    return divergences;
+}
+
+// The result of from_json_parallel, including what is left in values on error
+std::string parallel_trace(std::string input, size_t num_threads)
+{
+    // Already filled, to check that errors leave it alone
+    std::vector<int64_t> values = { 7 };
+    std::optional<structread::ParseContext::Error> error;
+    structread::ParallelOptions options;
+    options.num_threads = num_threads;
+    options.min_size = 0;
+    const auto ok
+        = structread::from_json_parallel(values, std::span<char>(input), error, options);
+    std::string trace = ok ? "ok" : "error";
+    for (const auto v : values) {
+        trace.push_back(' ');
+        trace.append(std::to_string(v));
+    }
+    if (error) {
+        trace.push_back('\n');
+        trace.append(std::to_string(error->location));
+        trace.push_back(' ');
+        append_printable(trace, error->message);
+    }
+    return trace;
+}
+
+// Compares from_json_parallel on multiple threads with the sequential fallback on arrays of
+// integers, some of which are not integers. Returns the number of divergences.
+size_t fuzz_parallel(const Options& options)
+{
+    static const std::vector<std::string> bad = { "x", "\"s\"", "1.5", "[1]", "{}", "-1e3" };
+    Random rng(options.seed);
+    size_t divergences = 0;
+    const auto iterations = std::max<size_t>(1, options.iterations / 10);
+    for (size_t it = 0; it < iterations; ++it) {
+        std::string input = "[";
+        for (auto n = rng.below(200); n > 0; --n) {
+            input.append(rng.chance(0.01) ? rng.pick(bad) : std::to_string(rng.next() % 1000));
+            input.append(n > 1 ? "," : "");
+        }
+        input.push_back(']');
+        if (rng.chance(0.3)) {
+            mutate(input, rng);
+        }
+        const auto sequential = parallel_trace(input, 1);
+        const auto parallel = parallel_trace(input, 4);
+        if (sequential == parallel) {
+            continue;
+        }
+        divergences++;
+        const auto path = "minijson2-fuzz-parallel-" + std::to_string(options.seed) + "-"
+            + std::to_string(it) + ".json";
+        const auto [expected, actual] = first_difference(sequential, parallel);
+        std::cerr << "Divergence of from_json_parallel in iteration " << it
+                  << ", input written to " << path << "\n  1 thread: " << expected
+                  << "\n  4 threads: " << actual << std::endl;
+        write_file(path, input);
+    }
+    std::cout << iterations << " arrays through from_json_parallel, " << divergences
+              << " divergences" << std::endl;
+    return divergences;
+}
+
+// Returns whether no engine regressed compared to the baseline
+bool check_baseline(const std::string& path, const std::vector<std::string>& names,
+    const std::vector<double>& throughput, double tolerance)
+{
+    auto data = read_file(path);
+    if (!data) {
+        std::cerr << "Could not read baseline '" << path << "'" << std::endl;
+        return false;
+    }
+    Parser parser(*data);
+    Document doc;
+    if (!doc.parse(parser) || !doc.root().is_object()) {
+        std::cerr << "Invalid baseline '" << path << "'" << std::endl;
+        return false;
+    }
+    bool ok = true;
+    for (size_t i = 0; i < names.size(); ++i) {
+        const auto value = doc.root().find(names[i]);
+        if (!value || !value->is_number()) {
+            continue; // A new engine
+        }
+        const auto baseline = value->as_double();
+        if (throughput[i] < baseline * (1.0 - tolerance)) {
+            std::cerr << "Regression: " << names[i] << " " << throughput[i] << " MB/s, baseline "
+                      << baseline << " MB/s" << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    const auto options = parse_args(argc, argv);
+    if (!options) {
+        std::cerr << "Usage: minijson2-fuzz [--iterations <n>] [--seed <n>] [--no-perf] "
+                     "[--repetitions <n>] [--baseline <file>] [--save-baseline <file>] "
+                     "[--tolerance <percent>] [<file>...]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> seeds;
+    for (const auto& entry : std::filesystem::directory_iterator(MINIJSON2_TEST_DIR)) {
+        if (entry.path().extension() == ".json") {
+            if (auto data = read_file(entry.path().string())) {
+                seeds.push_back(std::move(*data));
+            }
+        }
+    }
+    for (const auto& path : options->files) {
+        auto data = read_file(path);
+        if (!data) {
+            std::cerr << "Could not read file '" << path << "'" << std::endl;
+            return 1;
+        }
+        seeds.push_back(std::move(*data));
+    }
+
+    const auto engines = get_engines();
+    auto ok = fuzz(*options, engines, seeds) == 0;
+    ok = fuzz_parallel(*options) == 0 && ok;
+
+    if (options->perf) {
+        Random rng(options->seed);
+        Generator generator(rng);
+        auto inputs = seeds;
+        std::string generated = "[";
+        while (generated.size() < 1'000'000) {
+            generated.append(generator.document());
+            generated.push_back(',');
+        }
+        generated.back() = ']';
+        inputs.push_back(std::move(generated));
+
+        std::vector<std::string> names;
+        std::vector<double> throughput;
+        for (const auto& engine : engines) {
+            names.push_back(engine.name);
+            throughput.push_back(measure(engine, inputs, options->repetitions));
+            std::printf("%-24s %10.1f MB/s\n", engine.name.c_str(), throughput.back());
+        }
+        simd::use_level(simd::best_level());
+
+        if (options->baseline) {
+            ok = check_baseline(*options->baseline, names, throughput, options->tolerance) && ok;
+        }
+        if (options->save_baseline) {
+            Writer w({ .pretty = true });
+            w.begin_object();
+            for (size_t i = 0; i < names.size(); ++i) {
+                w.key(names[i]);
+                w.value(throughput[i]);
+            }
+            w.end_object();
+            if (!write_file(*options->save_baseline, w.output())) {
+                std::cerr << "Could not write '" << *options->save_baseline << "'" << std::endl;
+                ok = false;
+            }
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -1,4 +1,5 @@
 #include <cassert>
+#include <charconv>
 #include <chrono>
 #include <iostream>
 #include <sstream>
@@ -9,7 +10,14 @@
 #include <stdexcept>
 #include <variant>
 
+#include <minijson2/async.hpp>
+#include <minijson2/document.hpp>
+#include <minijson2/mapped_file.hpp>
 #include <minijson2/minijson2.hpp>
+#include <minijson2/ndjson.hpp>
+#include <minijson2/ondemand.hpp>
+#include <minijson2/query.hpp>
+#include <minijson2/writer.hpp>
 
 using namespace minijson2;
 
@@ -178,6 +186,46 @@ void print_value(const JsonValue& value, size_t indent = 0)
     }
 }
 
+void print_document(const Document::Value& value, size_t indent = 0)
+{
+    std::cout << std::string(4 * indent, ' ');
+    switch (value.type()) {
+    case Token::Type::Null:
+        std::cout << "null\n";
+        break;
+    case Token::Type::Bool:
+        std::cout << "bool: " << value.as_bool() << "\n";
+        break;
+    case Token::Type::UInt:
+        std::cout << "uint: " << value.as_uint() << "\n";
+        break;
+    case Token::Type::Int:
+        std::cout << "int: " << value.as_int() << "\n";
+        break;
+    case Token::Type::Float:
+        std::cout << "float: " << value.as_double() << "\n";
+        break;
+    case Token::Type::String:
+        std::cout << "string: " << value.as_string() << "\n";
+        break;
+    case Token::Type::Array:
+        std::cout << "array (" << value.size() << ")\n";
+        for (const auto elem : value.elements()) {
+            print_document(elem, indent + 1);
+        }
+        break;
+    case Token::Type::Object:
+        std::cout << "object (" << value.size() << ")\n";
+        for (const auto [key, member] : value.members()) {
+            std::cout << std::string(4 * (indent + 1), ' ') << "key: " << key << "\n";
+            print_document(member, indent + 1);
+        }
+        break;
+    default:
+        assert(false && "Invalid document node type");
+    }
+}
+
 std::string to_string(Token::Type type)
 {
     switch (type) {
@@ -203,6 +251,8 @@ std::string to_string(Token::Type type)
         return "EndObject";
     case Token::Type::Eof:
         return "Eof";
+    case Token::Type::NeedInput:
+        return "NeedInput";
     case Token::Type::Error:
         return "Error";
     default:
@@ -272,10 +322,14 @@ bool print_tree(Parser& parser, const Token& token, std::string indent = "")
     return true;
 }
 
-bool print_flat(Parser& parser)
+// With documents, the input is a batch of documents, which all end with an Eof token
+bool print_flat(Parser& parser, bool documents)
 {
     auto token = parser.next();
-    while (token.type() != Token::Type::Eof && token.type() != Token::Type::Error) {
+    while (token.type() != Token::Type::Error) {
+        if (token.type() == Token::Type::Eof && !(documents && parser.next_document())) {
+            break;
+        }
         std::cout << to_string(token) << std::endl;
         token = parser.next();
     }
@@ -289,6 +343,82 @@ bool print_flat(Parser& parser)
     return token.type() != Token::Type::Error;
 }
 
+// Like print_flat, but feeds the input to a StreamParser chunk by chunk
+bool print_stream(std::string_view input, size_t chunk_size, ParseOptions options)
+{
+    StreamParser parser(false, options);
+    size_t fed = 0;
+    auto token = parser.next();
+    while (token.type() != Token::Type::Eof && token.type() != Token::Type::Error) {
+        if (token.type() == Token::Type::NeedInput) {
+            if (fed < input.size()) {
+                const auto chunk = input.substr(fed, chunk_size);
+                parser.feed(chunk);
+                fed += chunk.size();
+            } else {
+                parser.finish();
+            }
+        } else {
+            std::cout << to_string(token) << std::endl;
+        }
+        token = parser.next();
+    }
+    std::cout << to_string(token) << std::endl;
+    if (token.type() == Token::Type::Error) {
+        const auto ctx = get_context(input, token.error_location());
+        std::cerr << "Line " << ctx.line_number << std::endl;
+        std::cerr << ctx.line << std::endl;
+        std::cerr << std::string(ctx.column, ' ') << "^" << std::endl;
+    }
+    return token.type() != Token::Type::Error;
+}
+
+// Containers are printed by nested tasks, to exercise awaiting tasks
+Task<bool> print_async_value(AsyncParser& parser, Token token)
+{
+    std::cout << to_string(token) << std::endl;
+    if (token.type() != Token::Type::Array && token.type() != Token::Type::Object) {
+        co_return token.type() != Token::Type::Error;
+    }
+    auto child = co_await parser.next();
+    while (child) {
+        if (!co_await print_async_value(parser, child)) {
+            co_return false;
+        }
+        child = co_await parser.next();
+    }
+    std::cout << to_string(child) << std::endl;
+    co_return child.type() != Token::Type::Error;
+}
+
+Task<bool> print_async_document(AsyncParser& parser)
+{
+    if (!co_await print_async_value(parser, co_await parser.next())) {
+        co_return false;
+    }
+    const auto eof = co_await parser.next();
+    std::cout << to_string(eof) << std::endl;
+    co_return eof.type() == Token::Type::Eof;
+}
+
+// Like print_stream, but the chunks are fed to a coroutine
+bool print_async(std::string_view input, size_t chunk_size, ParseOptions options)
+{
+    AsyncParser parser(false, options);
+    auto task = print_async_document(parser);
+    size_t fed = 0;
+    while (!task.done()) {
+        if (fed < input.size()) {
+            const auto chunk = input.substr(fed, chunk_size);
+            parser.feed(chunk);
+            fed += chunk.size();
+        } else {
+            parser.finish();
+        }
+    }
+    return task.result();
+}
+
 size_t full_parse(Parser& parser)
 {
     size_t v = 0; // silly var to avoid all work being optimized out
@@ -324,8 +454,30 @@ struct Args {
     bool print_flat = false;
     bool print_tree = false;
     bool print_dom = false;
+    bool print_doc = false;
+    bool print_json = false;
+    bool print_stats = false;
+    bool pretty = false;
     std::optional<int> bench_sax;
     std::optional<int> bench_dom;
+    std::optional<int> bench_doc;
+    std::optional<int> bench_ndjson;
+    std::optional<int> bench_write;
+    size_t num_threads = 0;
+    std::optional<int> print_stream;
+    std::optional<int> print_async;
+    // Dot-separated keys and indices for ondemand::Document, in document order
+    std::vector<std::string> get;
+    // A JSONPath if it starts with '$', otherwise a JSON Pointer
+    std::optional<std::string> query;
+    // Parse into a Document and save it there
+    std::optional<std::string> save_doc;
+    // The file is a saved Document, which is printed as JSON
+    bool load_doc = false;
+    bool mmap = false;
+    // The input is a batch of documents (only for --print-flat)
+    bool documents = false;
+    ParseOptions parse_options;
     std::string file;
 
     static std::optional<Args> parse(int argc, char** argv)
@@ -339,6 +491,45 @@ struct Args {
                 ret.print_tree = true;
             } else if (args[i] == "--print-dom") {
                 ret.print_dom = true;
+            } else if (args[i] == "--print-doc") {
+                ret.print_doc = true;
+            } else if (args[i] == "--print-stats") {
+                ret.print_stats = true;
+            } else if (args[i] == "--print-json") {
+                ret.print_json = true;
+            } else if (args[i] == "--print-pretty") {
+                ret.print_json = true;
+                ret.pretty = true;
+            } else if (args[i] == "--mmap") {
+                ret.mmap = true;
+            } else if (args[i] == "--documents") {
+                ret.documents = true;
+            } else if (args[i] == "--indexed") {
+                ret.parse_options.mode = ParseMode::Indexed;
+            } else if (args[i] == "--validate-utf8") {
+                ret.parse_options.validate_utf8 = true;
+            } else if (args[i] == "--print-stream") {
+                if (i + 1 >= args.size()) {
+                    std::cerr << "Missing chunk size for --print-stream" << std::endl;
+                    return std::nullopt;
+                }
+                ret.print_stream = std::stoi(args[i + 1]);
+                if (*ret.print_stream <= 0) {
+                    std::cerr << "Chunk size must be positive" << std::endl;
+                    return std::nullopt;
+                }
+                i++;
+            } else if (args[i] == "--print-async") {
+                if (i + 1 >= args.size()) {
+                    std::cerr << "Missing chunk size for --print-async" << std::endl;
+                    return std::nullopt;
+                }
+                ret.print_async = std::stoi(args[i + 1]);
+                if (*ret.print_async <= 0) {
+                    std::cerr << "Chunk size must be positive" << std::endl;
+                    return std::nullopt;
+                }
+                i++;
             } else if (args[i] == "--bench-sax") {
                 if (i + 1 >= args.size()) {
                     std::cerr << "Missing iterations for --bench-sax" << std::endl;
@@ -353,6 +544,57 @@ struct Args {
                 }
                 ret.bench_dom = std::stoi(args[i + 1]);
                 i++;
+            } else if (args[i] == "--bench-doc") {
+                if (i + 1 >= args.size()) {
+                    std::cerr << "Missing iterations for --bench-doc" << std::endl;
+                    return std::nullopt;
+                }
+                ret.bench_doc = std::stoi(args[i + 1]);
+                i++;
+            } else if (args[i] == "--bench-ndjson") {
+                if (i + 1 >= args.size()) {
+                    std::cerr << "Missing iterations for --bench-ndjson" << std::endl;
+                    return std::nullopt;
+                }
+                ret.bench_ndjson = std::stoi(args[i + 1]);
+                i++;
+            } else if (args[i] == "--bench-write") {
+                if (i + 1 >= args.size()) {
+                    std::cerr << "Missing iterations for --bench-write" << std::endl;
+                    return std::nullopt;
+                }
+                ret.bench_write = std::stoi(args[i + 1]);
+                i++;
+            } else if (args[i] == "--get") {
+                if (i + 1 >= args.size()) {
+                    std::cerr << "Missing path for --get" << std::endl;
+                    return std::nullopt;
+                }
+                ret.get.push_back(args[i + 1]);
+                i++;
+            } else if (args[i] == "--query") {
+                if (i + 1 >= args.size()) {
+                    std::cerr << "Missing query for --query" << std::endl;
+                    return std::nullopt;
+                }
+                ret.query = args[i + 1];
+                i++;
+            } else if (args[i] == "--save-doc") {
+                if (i + 1 >= args.size()) {
+                    std::cerr << "Missing path for --save-doc" << std::endl;
+                    return std::nullopt;
+                }
+                ret.save_doc = args[i + 1];
+                i++;
+            } else if (args[i] == "--load-doc") {
+                ret.load_doc = true;
+            } else if (args[i] == "--threads") {
+                if (i + 1 >= args.size()) {
+                    std::cerr << "Missing number of threads for --threads" << std::endl;
+                    return std::nullopt;
+                }
+                ret.num_threads = std::stoi(args[i + 1]);
+                i++;
             } else if (args[i].starts_with("--")) {
                 std::cerr << "Unknown flag '" << args[i] << "'" << std::endl;
                 return std::nullopt;
@@ -368,30 +610,60 @@ struct Args {
             std::cerr << "Missing positional argument 'file'" << std::endl;
             return std::nullopt;
         }
-        if (!ret.print_flat && !ret.print_tree && !ret.print_dom && !ret.bench_sax
-            && !ret.bench_dom) {
+        if (!ret.print_flat && !ret.print_tree && !ret.print_dom && !ret.print_doc
+            && !ret.print_json && !ret.print_stats && !ret.print_stream && !ret.print_async
+            && !ret.bench_sax && !ret.bench_dom && !ret.bench_doc && !ret.bench_ndjson
+            && !ret.bench_write && ret.get.empty() && !ret.query && !ret.save_doc
+            && !ret.load_doc) {
             ret.print_flat = true; // default if nothing else is set
         }
         return ret;
     }
 };
 
-int print_flat(std::string& json)
+// Either the file read into a string or mapped read-only (--mmap)
+struct Input {
+    std::string buffer;
+    std::optional<MappedFile> mapping;
+    std::string scratch;
+    ParseOptions options;
+
+    std::string_view data() const { return mapping ? mapping->data() : std::string_view(buffer); }
+
+    Parser parser()
+    {
+        if (mapping) {
+            return Parser(mapping->data(), scratch, options);
+        }
+        return Parser(buffer, options);
+    }
+
+    void reset(Parser& parser)
+    {
+        if (mapping) {
+            parser.reset(mapping->data(), scratch);
+        } else {
+            parser.reset(buffer);
+        }
+    }
+};
+
+int print_flat(Input& input, bool documents)
 {
-    Parser parser(json);
-    return print_flat(parser) ? 0 : 1;
+    auto parser = input.parser();
+    return print_flat(parser, documents) ? 0 : 1;
 }
 
-int print_tree(std::string& json)
+int print_tree(Input& input)
 {
-    Parser parser(json);
+    auto parser = input.parser();
     return print_tree(parser, parser.next()) ? 0 : 1;
 }
 
-int print_dom(std::string& json)
+int print_dom(Input& input)
 {
     std::pmr::monotonic_buffer_resource pool;
-    Parser parser(json);
+    auto parser = input.parser();
     try {
         const auto dom = to_dom(parser, parser.next(), &pool);
         print_value(dom);
@@ -402,24 +674,241 @@ int print_dom(std::string& json)
     }
 }
 
+int print_doc(Input& input)
+{
+    auto parser = input.parser();
+    Document doc;
+    if (!doc.parse(parser)) {
+        std::cerr << doc.error().error_message() << std::endl;
+        return 1;
+    }
+    print_document(doc.root());
+    return 0;
+}
+
+void write_value(Writer& writer, const Document::Value& value)
+{
+    switch (value.type()) {
+    case Token::Type::Null:
+        writer.null();
+        break;
+    case Token::Type::Bool:
+        writer.value(value.as_bool());
+        break;
+    case Token::Type::UInt:
+        writer.value(value.as_uint());
+        break;
+    case Token::Type::Int:
+        writer.value(value.as_int());
+        break;
+    case Token::Type::Float:
+        writer.value(value.as_double());
+        break;
+    case Token::Type::String:
+        writer.value(value.as_string());
+        break;
+    case Token::Type::Array:
+        writer.begin_array();
+        for (const auto elem : value.elements()) {
+            write_value(writer, elem);
+        }
+        writer.end_array();
+        break;
+    case Token::Type::Object:
+        writer.begin_object();
+        for (const auto& member : value.members()) {
+            writer.key(member.key);
+            write_value(writer, member.value);
+        }
+        writer.end_object();
+        break;
+    default:
+        std::abort();
+    }
+}
+
+int print_json(Input& input, bool pretty)
+{
+    auto parser = input.parser();
+    Document doc;
+    if (!doc.parse(parser)) {
+        std::cerr << doc.error().error_message() << std::endl;
+        return 1;
+    }
+    Writer writer({ .pretty = pretty });
+    write_value(writer, doc.root());
+    std::cout << writer.output() << std::endl;
+    return 0;
+}
+
+int save_doc(Input& input, const std::string& path)
+{
+    auto parser = input.parser();
+    Document doc;
+    if (!doc.parse(parser)) {
+        std::cerr << doc.error().error_message() << std::endl;
+        return 1;
+    }
+    if (!doc.save(path.c_str())) {
+        std::cerr << "Could not write '" << path << "'" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int load_doc(Input& input, bool pretty)
+{
+    Document doc;
+    if (!doc.load(input.data())) {
+        std::cerr << doc.error().error_message() << std::endl;
+        return 1;
+    }
+    Writer writer({ .pretty = pretty });
+    write_value(writer, doc.root());
+    std::cout << writer.output() << std::endl;
+    return 0;
+}
+
+int print_stats(Input& input)
+{
+#ifndef MINIJSON2_STATS
+    std::cerr << "minijson2 was built without MINIJSON2_STATS" << std::endl;
+#endif
+    auto parser = input.parser();
+    if (full_parse(parser) == 0) {
+        return 1;
+    }
+    const auto& stats = parser.stats();
+    const char* type_names[] = { "Null", "Bool", "UInt", "Int", "Float", "String", "Array",
+        "Object", "EndArray", "EndObject", "Eof", "NeedInput", "Error" };
+    static_assert(std::size(type_names) == ParseStats::num_token_types);
+    for (size_t i = 0; i < ParseStats::num_token_types; ++i) {
+        std::cout << type_names[i] << " tokens: " << stats.tokens[i] << std::endl;
+    }
+    std::cout << "Escaped bytes: " << stats.escaped_bytes << std::endl;
+    std::cout << "Skipped bytes: " << stats.skipped_bytes << std::endl;
+    std::cout << "Max depth: " << stats.max_depth << std::endl;
+    std::cout << "Allocations: " << stats.allocations << std::endl;
+    return 0;
+}
+
+void print_ondemand_value(const ondemand::Value& value)
+{
+    switch (value.type()) {
+    case Token::Type::Null:
+        std::cout << "null";
+        break;
+    case Token::Type::Bool:
+        std::cout << (*value.get_bool() ? "true" : "false");
+        break;
+    case Token::Type::UInt:
+        std::cout << *value.get_uint();
+        break;
+    case Token::Type::Int:
+        std::cout << *value.get_int();
+        break;
+    case Token::Type::Float:
+        std::cout << *value.get_double();
+        break;
+    case Token::Type::String:
+        std::cout << '"' << *value.get_string() << '"';
+        break;
+    case Token::Type::Array:
+        std::cout << "<array>";
+        break;
+    case Token::Type::Object:
+        std::cout << "<object>";
+        break;
+    default:
+        std::cout << "<invalid>";
+        break;
+    }
+}
+
+template <typename... Args>
+int get_ondemand(const std::vector<std::string>& paths, Args&&... args)
+{
+    ondemand::Document doc(std::forward<Args>(args)...);
+    for (const auto& path : paths) {
+        auto value = doc.root();
+        size_t start = 0;
+        while (value && start < path.size()) {
+            const auto end = std::min(path.find('.', start), path.size());
+            const auto part = std::string_view(path).substr(start, end - start);
+            size_t index = 0;
+            const auto res = std::from_chars(part.data(), part.data() + part.size(), index);
+            if (res.ec == std::errc() && res.ptr == part.data() + part.size()) {
+                value = value[index];
+            } else {
+                value = value[part];
+            }
+            start = end + 1;
+        }
+        std::cout << path << ": ";
+        print_ondemand_value(value);
+        std::cout << std::endl;
+    }
+    if (doc.failed()) {
+        const auto& error = doc.error();
+        std::cerr << "Error: " << error.error_message() << " at " << error.error_location()
+                  << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int get_ondemand(Input& input, const std::vector<std::string>& paths)
+{
+    if (input.mapping) {
+        return get_ondemand(paths, input.mapping->data(), input.scratch, input.options);
+    }
+    return get_ondemand(paths, input.buffer, input.options);
+}
+
+int print_query(Input& input, std::string_view query_str)
+{
+    const auto query
+        = query_str.starts_with('$') ? Query::path(query_str) : Query::pointer(query_str);
+    if (!query) {
+        std::cerr << "Invalid query '" << query_str << "'" << std::endl;
+        return 1;
+    }
+    auto parser = input.parser();
+    Query::Matcher matcher(*query, parser);
+    auto token = matcher.next();
+    while (token) {
+        if (!print_tree(parser, token)) {
+            return 1;
+        }
+        token = matcher.next();
+    }
+    if (token.type() == Token::Type::Error) {
+        std::cout << "Error: " << token.error_message() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
 auto delta_ms(std::chrono::high_resolution_clock::time_point start)
 {
     const auto delta = std::chrono::high_resolution_clock::now() - start;
     return std::chrono::duration_cast<std::chrono::milliseconds>(delta).count();
 }
 
-int bench_sax(std::string& json, size_t num_iterations)
+int bench_sax(Input& input, size_t num_iterations)
 {
     // One test parse to catch errors
-    Parser test_parser(json);
+    auto test_parser = input.parser();
     if (full_parse(test_parser) == 0) {
         return 1;
     }
 
+    // Reused like in a real loop over documents
+    auto bench_parser = input.parser();
     const auto start = std::chrono::high_resolution_clock::now();
     // This doesn't work properly if strings need to be escaped
     for (size_t i = 0; i < num_iterations; ++i) {
-        Parser bench_parser(json);
+        input.reset(bench_parser);
         if (full_parse(bench_parser) == static_cast<size_t>(-1)) {
             return 100;
         }
@@ -430,20 +919,22 @@ int bench_sax(std::string& json, size_t num_iterations)
     return 0;
 }
 
-int bench_dom(std::string& json, size_t num_iterations)
+int bench_dom(Input& input, size_t num_iterations)
 {
     // One test parse to catch errors
-    Parser test_parser(json);
+    auto test_parser = input.parser();
     if (full_parse(test_parser) == 0) {
         return 1;
     }
 
     std::pmr::monotonic_buffer_resource pool;
+    // Reused like in a real loop over documents
+    auto bench_parser = input.parser();
     const auto start = std::chrono::high_resolution_clock::now();
     // This doesn't work properly if strings need to be escaped
     for (size_t i = 0; i < num_iterations; ++i) {
         pool.release();
-        Parser bench_parser(json);
+        input.reset(bench_parser);
         const auto dom = to_dom(bench_parser, bench_parser.next(), &pool);
         if (dom.size() == static_cast<size_t>(-1)) { // Just prevent dom from being optimized out
             return 100;
@@ -455,54 +946,203 @@ int bench_dom(std::string& json, size_t num_iterations)
     return 0;
 }
 
-int main(int argc, char** argv)
+int bench_doc(Input& input, size_t num_iterations)
 {
-    const auto args = Args::parse(argc, argv);
-    if (!args) {
-        std::cerr << "Usage: minijson-test [--print-flat] [--print-tree] [--print-dom] "
-                     "[--bench-sax <iterations>] [--bench-dom <iterations>] <file>"
-                  << std::endl;
+    // One test parse to catch errors
+    auto test_parser = input.parser();
+    if (full_parse(test_parser) == 0) {
         return 1;
     }
 
-    FILE* f = std::fopen(args->file.c_str(), "rb");
-    if (!f) {
-        std::cerr << "Could not open file '" << args->file << "'" << std::endl;
+    Document doc;
+    // Reused like in a real loop over documents
+    auto bench_parser = input.parser();
+    const auto start = std::chrono::high_resolution_clock::now();
+    // This doesn't work properly if strings need to be escaped
+    for (size_t i = 0; i < num_iterations; ++i) {
+        input.reset(bench_parser);
+        if (!doc.parse(bench_parser)) {
+            return 100;
+        }
+    }
+    const auto delta = delta_ms(start);
+    std::cerr << num_iterations << " iterations: " << delta << "ms" << std::endl;
+    std::cerr << "Per parse: " << static_cast<float>(delta) / num_iterations << "ms" << std::endl;
+    return 0;
+}
+
+int bench_ndjson(Input& input, size_t num_iterations, size_t num_threads)
+{
+    if (input.mapping) {
+        std::cerr << "--bench-ndjson needs mutable input" << std::endl;
         return 1;
     }
-    std::fseek(f, 0, SEEK_END);
-    const auto size = std::ftell(f);
-    if (size < 0) {
-        std::cerr << "Error getting file size" << std::endl;
+
+    NdjsonOptions options;
+    options.num_threads = num_threads;
+    options.parse_options = input.options;
+    NdjsonParser ndjson(options);
+
+    // One test parse to catch errors
+    const auto test_result = ndjson.parse(input.buffer, true, [](Parser& parser, size_t, size_t) {
+        auto token = parser.next();
+        while (token.type() != Token::Type::Eof && token.type() != Token::Type::Error) {
+            token = parser.next();
+        }
+        return token.type() != Token::Type::Error;
+    });
+    if (!test_result.ok) {
         return 1;
     }
-    std::fseek(f, 0, SEEK_SET);
-    std::string json;
-    json.resize(size);
-    const auto readRes = std::fread(json.data(), 1, size, f);
-    if (readRes != static_cast<size_t>(size)) {
-        std::cerr << "Error reading file: " << readRes << std::endl;
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    // This doesn't work properly if strings need to be escaped
+    for (size_t i = 0; i < num_iterations; ++i) {
+        ndjson.parse(input.buffer, true, [](Parser& parser, size_t, size_t) {
+            return full_parse(parser) != static_cast<size_t>(-1);
+        });
+    }
+    const auto delta = delta_ms(start);
+    std::cerr << test_result.num_lines << " lines, " << ndjson.num_threads() << " threads"
+              << std::endl;
+    std::cerr << num_iterations << " iterations: " << delta << "ms" << std::endl;
+    std::cerr << "Per parse: " << static_cast<float>(delta) / num_iterations << "ms" << std::endl;
+    return 0;
+}
+
+int bench_write(Input& input, size_t num_iterations, bool pretty)
+{
+    auto parser = input.parser();
+    Document doc;
+    if (!doc.parse(parser)) {
+        std::cerr << doc.error().error_message() << std::endl;
+        return 1;
+    }
+
+    Writer writer({ .pretty = pretty });
+    const auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < num_iterations; ++i) {
+        writer.clear();
+        write_value(writer, doc.root());
+    }
+    const auto delta = delta_ms(start);
+    std::cerr << writer.output().size() << " bytes" << std::endl;
+    std::cerr << num_iterations << " iterations: " << delta << "ms" << std::endl;
+    std::cerr << "Per write: " << static_cast<float>(delta) / num_iterations << "ms" << std::endl;
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    const auto args = Args::parse(argc, argv);
+    if (!args) {
+        std::cerr << "Usage: minijson-test [--print-flat] [--print-tree] [--print-dom] "
+                     "[--print-doc] [--print-json] [--print-pretty] [--print-stats] "
+                     "[--print-stream <chunk size>] [--print-async <chunk size>] "
+                     "[--bench-sax <iterations>] [--bench-dom <iterations>] "
+                     "[--bench-doc <iterations>] [--bench-ndjson <iterations>] "
+                     "[--bench-write <iterations>] [--get <path>]... [--query <query>] "
+                     "[--save-doc <path>] [--load-doc] [--threads <n>] [--indexed] "
+                     "[--validate-utf8] [--mmap] [--documents] <file>"
+                  << std::endl;
         return 1;
     }
 
+    Input input;
+    input.options = args->parse_options;
+    if (args->mmap) {
+        input.mapping = MappedFile::open(args->file.c_str());
+        if (!input.mapping) {
+            std::cerr << "Could not map file '" << args->file << "'" << std::endl;
+            return 1;
+        }
+    } else {
+        FILE* f = std::fopen(args->file.c_str(), "rb");
+        if (!f) {
+            std::cerr << "Could not open file '" << args->file << "'" << std::endl;
+            return 1;
+        }
+        std::fseek(f, 0, SEEK_END);
+        const auto size = std::ftell(f);
+        if (size < 0) {
+            std::cerr << "Error getting file size" << std::endl;
+            return 1;
+        }
+        std::fseek(f, 0, SEEK_SET);
+        input.buffer.resize(size);
+        const auto readRes = std::fread(input.buffer.data(), 1, size, f);
+        if (readRes != static_cast<size_t>(size)) {
+            std::cerr << "Error reading file: " << readRes << std::endl;
+            return 1;
+        }
+    }
+
     if (args->print_flat) {
-        return print_flat(json);
+        return print_flat(input, args->documents);
     }
 
     if (args->print_tree) {
-        return print_tree(json);
+        return print_tree(input);
     }
 
     if (args->print_dom) {
-        return print_dom(json);
+        return print_dom(input);
+    }
+
+    if (args->print_doc) {
+        return print_doc(input);
+    }
+
+    if (args->print_json) {
+        return print_json(input, args->pretty);
+    }
+
+    if (args->print_stats) {
+        return print_stats(input);
+    }
+
+    if (args->save_doc) {
+        return save_doc(input, *args->save_doc);
+    }
+
+    if (args->load_doc) {
+        return load_doc(input, args->pretty);
+    }
+
+    if (args->query) {
+        return print_query(input, *args->query);
+    }
+
+    if (!args->get.empty()) {
+        return get_ondemand(input, args->get);
+    }
+
+    if (args->print_stream) {
+        return print_stream(input.data(), *args->print_stream, input.options) ? 0 : 1;
+    }
+
+    if (args->print_async) {
+        return print_async(input.data(), *args->print_async, input.options) ? 0 : 1;
     }
 
     if (args->bench_sax) {
-        return bench_sax(json, *args->bench_sax);
+        return bench_sax(input, *args->bench_sax);
     }
 
     if (args->bench_dom) {
-        return bench_dom(json, *args->bench_dom);
+        return bench_dom(input, *args->bench_dom);
+    }
+
+    if (args->bench_doc) {
+        return bench_doc(input, *args->bench_doc);
+    }
+
+    if (args->bench_ndjson) {
+        return bench_ndjson(input, *args->bench_ndjson, args->num_threads);
+    }
+
+    if (args->bench_write) {
+        return bench_write(input, *args->bench_write, args->pretty);
     }
 
     return 200;
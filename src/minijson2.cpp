@@ -1,13 +1,83 @@
 #include "minijson2/minijson2.hpp"
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <charconv>
+#include <cstring>
+#include <functional>
 #include <optional>
 
+#include "simd.hpp"
+
 namespace {
+// Parser::on_value dispatches on these, so it needs only a single (well predicted) branch to get
+// to the code for the kind of value in front of it
+enum class CharClass : uint8_t {
+    Other,
+    Whitespace,
+    Quote,
+    BeginArray,
+    BeginObject,
+    // '-' and digits
+    NumberStart,
+    // Characters that can be part of true, false, null or a number (and some more, to report
+    // errors for bare words)
+    Literal,
+};
+
+constexpr auto char_classes = []() {
+    std::array<CharClass, 256> table {};
+    const auto set = [&table](std::string_view chars, CharClass cls) {
+        for (const auto ch : chars) {
+            table[static_cast<unsigned char>(ch)] = cls;
+        }
+    };
+    set("abcdefghijlmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ.+", CharClass::Literal);
+    set("-0123456789", CharClass::NumberStart);
+    set(" \t\n\r", CharClass::Whitespace);
+    set("\"", CharClass::Quote);
+    set("[", CharClass::BeginArray);
+    set("{", CharClass::BeginObject);
+    return table;
+}();
+
+CharClass char_class(char ch)
+{
+    return char_classes[static_cast<unsigned char>(ch)];
+}
+
 bool is_whitespace(char ch)
 {
-    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\t';
+    return char_class(ch) == CharClass::Whitespace;
+}
+
+bool is_value_char(char ch)
+{
+    const auto cls = char_class(ch);
+    return cls == CharClass::NumberStart || cls == CharClass::Literal;
+}
+
+constexpr auto number_chars = "0123456789eE.-+";
+
+bool is_number_char(char ch)
+{
+    return (ch >= '0' && ch <= '9') || ch == 'e' || ch == 'E' || ch == '.' || ch == '-'
+        || ch == '+';
+}
+
+bool is_digit(char ch)
+{
+    return ch >= '0' && ch <= '9';
+}
+
+// All powers of ten that are exactly representable as a double
+constexpr double powers_of_ten[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+bool is_hex_digit(char ch)
+{
+    return (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'f') || (ch >= 'A' && ch <= 'F');
 }
 
 template <typename T>
@@ -21,16 +91,57 @@ std::optional<T> parse_number(std::string_view str)
     return value;
 }
 
-uint16_t parse_unicode_escape_hex(std::string_view str)
+// Returns the length of the valid UTF-8 sequence starting at the non-ASCII byte str[pos] or 0 if it
+// is invalid, in which case error is set to the offending byte (or to str.size() if the sequence is
+// cut off by the end of the input).
+size_t utf8_sequence_length(std::string_view str, size_t pos, size_t& error)
+{
+    const auto byte = [str](size_t i) { return static_cast<unsigned char>(str[i]); };
+    const auto lead = byte(pos);
+    size_t length = 0;
+    // The range of the second byte excludes overlong encodings, surrogates and code points above
+    // U+10FFFF (see table 3-7 of the Unicode standard).
+    unsigned char min = 0x80;
+    unsigned char max = 0xBF;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        min = lead == 0xE0 ? 0xA0 : min;
+        max = lead == 0xED ? 0x9F : max;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        min = lead == 0xF0 ? 0x90 : min;
+        max = lead == 0xF4 ? 0x8F : max;
+    } else {
+        error = pos;
+        return 0;
+    }
+    for (size_t i = 1; i < length; ++i) {
+        if (pos + i >= str.size()) {
+            error = str.size();
+            return 0;
+        }
+        const auto cont = byte(pos + i);
+        if (cont < min || cont > max) {
+            error = pos + i;
+            return 0;
+        }
+        min = 0x80;
+        max = 0xBF;
+    }
+    return length;
+}
+
+uint16_t parse_unicode_escape_hex(const char* str)
 {
     uint16_t value = 0;
-    [[maybe_unused]] const auto [ptr, ec]
-        = std::from_chars(str.data(), str.data() + str.size(), value, 16);
-    assert(ec == std::errc() && ptr == str.data() + str.size());
+    [[maybe_unused]] const auto [ptr, ec] = std::from_chars(str, str + 4, value, 16);
+    assert(ec == std::errc() && ptr == str + 4);
     return value;
 }
 
-size_t encode_utf8(char* dst, uint16_t cp)
+size_t encode_utf8(char* dst, uint32_t cp)
 {
     if (cp <= 0x7F) {
         // 1-byte sequence
@@ -41,13 +152,56 @@ size_t encode_utf8(char* dst, uint16_t cp)
         dst[0] = static_cast<char>(0b11000000 | ((cp >> 6) & 0b00011111));
         dst[1] = static_cast<char>(0b10000000 | (cp & 0b00111111));
         return 2;
+    } else if (cp <= 0xFFFF) {
+        // 3-byte sequence
+        dst[0] = static_cast<char>(0b11100000 | ((cp >> 12) & 0b00001111));
+        dst[1] = static_cast<char>(0b10000000 | ((cp >> 6) & 0b00111111));
+        dst[2] = static_cast<char>(0b10000000 | (cp & 0b00111111));
+        return 3;
     }
 
-    // 3-byte sequence
-    dst[0] = static_cast<char>(0b11100000 | ((cp >> 12) & 0b00001111));
-    dst[1] = static_cast<char>(0b10000000 | ((cp >> 6) & 0b00111111));
-    dst[2] = static_cast<char>(0b10000000 | (cp & 0b00111111));
-    return 3;
+    // 4-byte sequence
+    dst[0] = static_cast<char>(0b11110000 | ((cp >> 18) & 0b00000111));
+    dst[1] = static_cast<char>(0b10000000 | ((cp >> 12) & 0b00111111));
+    dst[2] = static_cast<char>(0b10000000 | ((cp >> 6) & 0b00111111));
+    dst[3] = static_cast<char>(0b10000000 | (cp & 0b00111111));
+    return 4;
+}
+
+bool is_high_surrogate(uint16_t unit)
+{
+    return unit >= 0xD800 && unit <= 0xDBFF;
+}
+
+bool is_low_surrogate(uint16_t unit)
+{
+    return unit >= 0xDC00 && unit <= 0xDFFF;
+}
+
+// Decodes the \u escape at str[0] (including a following low surrogate escape, if str[0] is a high
+// surrogate) and returns the code point. Surrogates that are not part of a pair can not be encoded
+// in UTF-8, so they are replaced with U+FFFD. num_read is the number of input chars consumed.
+uint32_t decode_unicode_escape(const char* str, size_t len, size_t& num_read)
+{
+    assert(len >= 6 && str[0] == '\\' && str[1] == 'u');
+    const auto unit = parse_unicode_escape_hex(str + 2);
+    num_read = 6;
+    if (is_low_surrogate(unit)) {
+        return 0xFFFD;
+    }
+    if (!is_high_surrogate(unit)) {
+        return unit;
+    }
+    if (len < 12 || str[6] != '\\' || str[7] != 'u') {
+        return 0xFFFD;
+    }
+    const auto low = parse_unicode_escape_hex(str + 8);
+    if (!is_low_surrogate(low)) {
+        // Only the high surrogate is replaced, the next escape is decoded on its own
+        return 0xFFFD;
+    }
+    num_read = 12;
+    return 0x10000 + ((static_cast<uint32_t>(unit - 0xD800) << 10) | (low - 0xDC00));
 }
 }
 
@@ -55,12 +209,17 @@ namespace minijson2 {
 
 size_t escape_string(char* str, size_t len)
 {
-    size_t dst = 0;
-    for (size_t src = 0; src < len; ++src) {
-        if (str[src] == '\\') {
+    // The first escape sequence can be found without copying anything
+    size_t src = simd::find_string_special(str, len, 0);
+    size_t dst = src;
+    while (src < len) {
+        if (str[src] != '\\') {
+            // Quotes and control characters are only special to the tokenizer
+            str[dst++] = str[src++];
+        } else {
             assert(src + 1 < len);
-            src++;
-            switch (str[src]) {
+            size_t num_read = 2;
+            switch (str[src + 1]) {
             case '"':
                 str[dst++] = '"';
                 break;
@@ -86,25 +245,27 @@ size_t escape_string(char* str, size_t len)
                 str[dst++] = '\t';
                 break;
             case 'u': {
-                // TODO: Surrogate pairs to encode code points above U+FFFF.
-                assert(src + 4 < len);
-                const std::string_view seq(str + src + 1, 4);
-                const auto val = parse_unicode_escape_hex(seq);
-                dst += encode_utf8(str + dst, val);
-                src += 4; // the last hex char will be skipped by the for loop
+                const auto cp = decode_unicode_escape(str + src, len - src, num_read);
+                // The UTF-8 sequence is never longer than the escape sequence
+                dst += encode_utf8(str + dst, cp);
                 break;
             }
             default:
                 break;
             }
-        } else {
-            str[dst++] = str[src];
+            src += num_read;
         }
+
+        // Move the run up to the next escape sequence at once
+        const auto next = simd::find_string_special(str, len, src);
+        std::memmove(str + dst, str + src, next - src);
+        dst += next - src;
+        src = next;
     }
+#ifndef NDEBUG
     // Fill up with zeros to make moved chars more obvious
-    for (size_t i = dst; i < len; ++i) {
-        str[i] = '\0';
-    }
+    std::memset(str + dst, 0, len - dst);
+#endif
     return dst;
 }
 
@@ -137,6 +298,39 @@ Context get_context(std::string_view str, size_t cursor)
     };
 }
 
+LineIndex::LineIndex(std::string_view str) : str_(str)
+{
+    line_starts_.push_back(0);
+    // memchr is vectorized in every libc and lines are usually long enough for that to pay off
+    const auto begin = str.data();
+    const auto end = begin + str.size();
+    auto pos = begin;
+    while (const auto nl = static_cast<const char*>(std::memchr(pos, '\n', end - pos))) {
+        pos = nl + 1;
+        line_starts_.push_back(static_cast<size_t>(pos - begin));
+    }
+}
+
+Context LineIndex::get_context(size_t cursor) const
+{
+    // A newline belongs to the line it ends, so the line is the last one starting at or before the
+    // cursor
+    const auto next = std::upper_bound(line_starts_.begin(), line_starts_.end(), cursor);
+    const auto line = static_cast<size_t>(next - line_starts_.begin()) - 1;
+    const auto line_start = line_starts_[line];
+    const auto line_end = next == line_starts_.end() ? str_.size() : *next - 1;
+    return Context {
+        .line_number = line + 1,
+        .column = cursor - line_start,
+        .line = str_.substr(line_start, line_end - line_start),
+    };
+}
+
+size_t LineIndex::num_lines() const
+{
+    return line_starts_.size();
+}
+
 Token::Token() : Token(0, "Default constructed token") { }
 
 // Regular token
@@ -144,6 +338,14 @@ Token::Token(Type type, std::string_view str) : str_(str.data()), length_(str.si
 {
 }
 
+Token::Token(std::string_view str, bool has_escapes)
+    : str_(str.data())
+    , length_(str.size())
+    , type_(Type::String)
+    , has_escapes_(has_escapes)
+{
+}
+
 Token::Token(size_t cursor, const char* message)
     : str_(message)
     , length_(cursor)
@@ -174,21 +376,90 @@ std::string_view Token::error_message() const
     return str_;
 }
 
+bool Token::has_escapes() const
+{
+    assert(type_ == Type::String);
+    return has_escapes_;
+}
+
 Token::operator bool() const
 {
     return static_cast<uint8_t>(type_) < static_cast<uint8_t>(Type::EndArray);
 }
 
-Parser::Parser(std::string& input) : input_buffer_(input), input_(input)
+Parser::Parser(std::string& input, ParseOptions options)
+    : Parser(input.data(), input, nullptr, options)
+{
+}
+
+Parser::Parser(std::span<char> input, ParseOptions options)
+    : Parser(input.data(), std::string_view(input.data(), input.size()), nullptr, options)
+{
+}
+
+Parser::Parser(std::string_view input, std::string& scratch, ParseOptions options)
+    : Parser(nullptr, input, &scratch, options)
+{
+}
+
+Parser::Parser(char* buffer, std::string_view input, std::string* scratch, ParseOptions options)
+    : options_(options)
+{
+    init(buffer, input, scratch);
+}
+
+void Parser::reset(std::string& input)
+{
+    init(input.data(), input, nullptr);
+}
+
+void Parser::reset(std::span<char> input)
+{
+    init(input.data(), std::string_view(input.data(), input.size()), nullptr);
+}
+
+void Parser::reset(std::string_view input, std::string& scratch)
 {
-    expect_next_.reserve(512);
-    // Only one value per document
-    expect_next_.push_back(ExpectNext::Value);
+    init(nullptr, input, &scratch);
+}
+
+void Parser::init(char* buffer, std::string_view input, std::string* scratch)
+{
+    buffer_ = buffer;
+    scratch_ = scratch;
+    input_ = input;
+    cursor_ = 0;
+    state_ = State::Value;
+    after_value_ = State::Done;
+    depth_ = 0;
+    error_message_ = nullptr;
+    mode_ = options_.mode;
+    index_pos_ = 0;
+    partial_ = false;
+    need_input_ = false;
+    number_cache_.str = nullptr;
+#ifdef MINIJSON2_STATS
+    stats_ = ParseStats {};
+#endif
+
+    if (mode_ == ParseMode::Indexed) {
+        if (input_.size() <= simd::max_indexed_size) {
+#ifdef MINIJSON2_STATS
+            const auto capacity = structural_index_.capacity();
+#endif
+            simd::build_structural_index(input_.data(), input_.size(), structural_index_);
+#ifdef MINIJSON2_STATS
+            stats_.allocations += structural_index_.capacity() != capacity;
+#endif
+        } else {
+            mode_ = ParseMode::Default;
+        }
+    }
 }
 
 size_t Parser::get_location(const Token& token) const
 {
-    return token.string().data() - input_buffer_.data();
+    return token.string().data() - input_.data();
 }
 
 std::string_view Parser::input() const
@@ -196,51 +467,215 @@ std::string_view Parser::input() const
     return input_;
 }
 
+const ParseStats& Parser::stats() const
+{
+#ifdef MINIJSON2_STATS
+    return stats_;
+#else
+    static const ParseStats empty;
+    return empty;
+#endif
+}
+
+#ifdef MINIJSON2_STATS
 Token Parser::next()
 {
-    if (expect_next_.empty()) {
-        return Token(Token::Type::Eof, input_.substr(cursor_, input_.size() - cursor_));
+    const auto token = next_token();
+    // StreamParser will try again
+    if (!need_input_) {
+        stats_.tokens[static_cast<size_t>(token.type())]++;
     }
-    const auto expect = expect_next_.back();
-    expect_next_.pop_back();
+    return token;
+}
 
-    switch (expect) {
-    case ExpectNext::Error:
-        return Token(cursor_, error_message_);
-    case ExpectNext::Value:
+Token Parser::next_token()
+#else
+// Without stats there is nothing to wrap, so this is next() itself. Even an inlined wrapper
+// measurably changed the code generated for the state machine.
+Token Parser::next()
+#endif
+{
+    switch (state_) {
+    case State::Value:
         return on_value();
-    case ExpectNext::ObjectKey:
-        return on_object_key();
-    case ExpectNext::ObjectValue:
+    case State::ArrayNext:
+        skip_whitespace();
+        if (cursor_ >= input_.size()) {
+            return end_of_input_token("Unterminated array");
+        }
+        // The common case first
+        if (input_[cursor_] == ',') {
+            cursor_++; // skip comma
+            return on_value();
+        }
+        if (input_[cursor_] == ']') {
+            return end_container(Token::Type::EndArray);
+        }
+        return error_token("Expected ',' or ']' after array element");
+    case State::ArrayStart:
+        skip_whitespace();
+        if (cursor_ >= input_.size()) {
+            return end_of_input_token("Unterminated array");
+        }
+        if (input_[cursor_] == ']') {
+            return end_container(Token::Type::EndArray);
+        }
+        return on_value();
+    case State::ObjectValue:
         return on_object_value();
-    case ExpectNext::ArrayValue:
-        return on_array_value();
-    default:
-        std::abort();
+    case State::ObjectNext:
+        skip_whitespace();
+        if (cursor_ >= input_.size()) {
+            return end_of_input_token("Unterminated object");
+        }
+        if (input_[cursor_] == ',') {
+            cursor_++; // skip comma
+            return on_object_key();
+        }
+        if (input_[cursor_] == '}') {
+            return end_container(Token::Type::EndObject);
+        }
+        return error_token("Expected ',' or '}' after object member");
+    case State::ObjectStart:
+        skip_whitespace();
+        if (cursor_ < input_.size() && input_[cursor_] == '}') {
+            return end_container(Token::Type::EndObject);
+        }
+        return on_object_key();
+    case State::Done:
+        return Token(Token::Type::Eof, input_.substr(cursor_, input_.size() - cursor_));
+    case State::Error:
+        return Token(cursor_, error_message_);
     }
+    std::abort();
 }
 
 bool Parser::skip(const Token& token)
+{
+#ifdef MINIJSON2_STATS
+    const auto start = token.type() == Token::Type::Error ? cursor_ : get_location(token);
+    const auto ok = skip_value(token);
+    stats_.skipped_bytes += cursor_ - start;
+    return ok;
+#else
+    return skip_value(token);
+#endif
+}
+
+bool Parser::next_document()
+{
+    const auto at_start = state_ == State::Value && depth_ == 0;
+    if (state_ != State::Done && !at_start) {
+        return false;
+    }
+    skip_whitespace();
+    if (cursor_ >= input_.size()) {
+        return false;
+    }
+    state_ = State::Value;
+    return true;
+}
+
+bool Parser::skip_value(const Token& token)
 {
     assert(token.type() != Token::Type::EndArray && token.type() != Token::Type::EndObject);
     if (token.type() == Token::Type::Error) {
         return false;
     }
-    if (token.type() == Token::Type::Array) {
-        while (const auto elem = next()) {
-            if (!skip(elem)) {
+    if (token.type() != Token::Type::Array && token.type() != Token::Type::Object) {
+        return true;
+    }
+    if (options_.skip_mode == SkipMode::Fast) {
+        return skip_container_fast(token.type() == Token::Type::Object);
+    }
+    // Counting the depth instead of recursing, so deeply nested values can not overflow the stack
+    size_t depth = 1;
+    while (depth > 0) {
+        switch (next().type()) {
+        case Token::Type::Error:
+            return false;
+        case Token::Type::Array:
+        case Token::Type::Object:
+            depth++;
+            break;
+        case Token::Type::EndArray:
+        case Token::Type::EndObject:
+            depth--;
+            break;
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+bool Parser::skip_container_fast(bool object)
+{
+    const auto data = input_.data();
+    const auto size = input_.size();
+    size_t depth = 1;
+    auto pos = cursor_;
+
+    if (mode_ == ParseMode::Indexed) {
+        // Quotes and brackets inside of strings are not in the index, so only the brackets have to
+        // be counted. Unterminated strings simply run until the sentinel.
+        next_index_entry();
+        while (true) {
+            const auto entry = structural_index_[index_pos_++];
+            pos = entry & simd::index_offset_mask;
+            if (pos >= size) {
+                cursor_ = size;
+                end_of_input_token(object ? "Unterminated object" : "Unterminated array");
                 return false;
             }
+            if (entry & simd::index_closing_quote) {
+                continue;
+            }
+            const auto ch = data[pos];
+            if (ch == '[' || ch == '{') {
+                depth++;
+            } else if ((ch == ']' || ch == '}') && --depth == 0) {
+                break;
+            }
         }
-    }
-    if (token.type() == Token::Type::Object) {
-        while (const auto key = next()) {
-            const auto value = next();
-            if (!skip(value)) {
+    } else {
+        while (true) {
+            pos = simd::find_quote_or_bracket(data, size, pos);
+            if (pos >= size) {
+                cursor_ = size;
+                end_of_input_token(object ? "Unterminated object" : "Unterminated array");
                 return false;
             }
+            const auto ch = data[pos];
+            if (ch == '"') {
+                // Only the closing quote matters, so control characters in the string are ignored
+                // like everything else and escapes are just jumped over.
+                const auto quote = pos;
+                pos++;
+                while (true) {
+                    pos = simd::find_string_special(data, size, pos);
+                    if (pos >= size) {
+                        cursor_ = quote;
+                        end_of_input_token("Unterminated string");
+                        return false;
+                    }
+                    if (data[pos] == '"') {
+                        break;
+                    }
+                    pos += data[pos] == '\\' ? 2 : 1;
+                }
+            } else if (ch == '[' || ch == '{') {
+                depth++;
+            } else if (--depth == 0) {
+                break;
+            }
+            pos++;
         }
     }
+
+    cursor_ = pos;
+    // Whether the closing bracket matches the opening one is not checked either
+    end_container(object ? Token::Type::EndObject : Token::Type::EndArray);
     return true;
 }
 
@@ -248,17 +683,35 @@ std::string_view Parser::parse_string(const Token& token, bool escape_in_place)
 {
     assert(token.type() == Token::Type::String);
     const auto sv = token.string();
-    auto len = sv.size();
-    if (escape_in_place) {
-        const auto offset = sv.data() - input_buffer_.data();
-        len = escape_string(input_buffer_.data() + offset, sv.size());
+    if (!escape_in_place || !token.has_escapes()) {
+        return sv;
+    }
+#ifdef MINIJSON2_STATS
+    stats_.escaped_bytes += sv.size();
+#endif
+    if (!buffer_) {
+#ifdef MINIJSON2_STATS
+        stats_.allocations += sv.size() > scratch_->capacity();
+#endif
+        scratch_->assign(sv);
+        const auto len = escape_string(scratch_->data(), sv.size());
+        return std::string_view(scratch_->data(), len);
     }
-    return sv.substr(0, len);
+    const auto offset = sv.data() - buffer_;
+    return sv.substr(0, escape_string(buffer_ + offset, sv.size()));
 }
 
 int64_t Parser::parse_int(const Token& token)
 {
     assert(token.type() == Token::Type::UInt || token.type() == Token::Type::Int);
+    if (token.string().data() == number_cache_.str) {
+        if (token.type() == Token::Type::Int) {
+            return number_cache_.int_;
+        }
+        if (number_cache_.uint <= static_cast<uint64_t>(std::numeric_limits<int64_t>::max())) {
+            return static_cast<int64_t>(number_cache_.uint);
+        }
+    }
     // should work if type is uint or int
     return parse_number<int64_t>(token.string()).value();
 }
@@ -266,6 +719,9 @@ int64_t Parser::parse_int(const Token& token)
 uint64_t Parser::parse_uint(const Token& token)
 {
     assert(token.type() == Token::Type::UInt);
+    if (token.string().data() == number_cache_.str) {
+        return number_cache_.uint;
+    }
     // should work if type is uint
     return parse_number<uint64_t>(token.string()).value();
 }
@@ -274,7 +730,29 @@ double Parser::parse_float(const Token& token)
 {
     assert(token.type() == Token::Type::UInt || token.type() == Token::Type::Int
         || token.type() == Token::Type::Float);
-    return parse_number<double>(token.string()).value();
+    if (token.string().data() == number_cache_.str) {
+        switch (token.type()) {
+        case Token::Type::UInt:
+            return static_cast<double>(number_cache_.uint);
+        case Token::Type::Int:
+            // "-0" is the only negative zero
+            return number_cache_.int_ == 0 ? -0.0 : static_cast<double>(number_cache_.int_);
+        default:
+            return number_cache_.float_;
+        }
+    }
+    const auto str = token.string();
+    double value = 0.0;
+    const auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+    assert(ptr == str.data() + str.size());
+    if (ec == std::errc::result_out_of_range) {
+        // Not representable, so it's either too small or too large
+        const auto exponent = str.find_first_of("eE");
+        const auto tiny = exponent != std::string_view::npos && str[exponent + 1] == '-';
+        const auto magnitude = tiny ? 0.0 : std::numeric_limits<double>::infinity();
+        return str[0] == '-' ? -magnitude : magnitude;
+    }
+    return value;
 }
 
 bool Parser::parse_bool(const Token& token)
@@ -287,30 +765,37 @@ Token Parser::on_value()
 {
     skip_whitespace();
     if (cursor_ >= input_.size()) {
-        return error_token("Expected value");
+        return end_of_input_token("Expected value");
     }
 
-    if (input_[cursor_] == '"') {
-        return string_token();
-    }
+    // Errors will override this
+    state_ = after_value_;
 
-    if (input_[cursor_] == '{') {
+    switch (char_class(input_[cursor_])) {
+    case CharClass::Quote:
+        return string_token();
+    case CharClass::NumberStart:
+        return number_token();
+    case CharClass::BeginObject:
+        push_container(true);
         cursor_++; // skip opening brace
-        expect_next_.push_back(ExpectNext::ObjectKey);
         return Token(Token::Type::Object, input_.substr(cursor_ - 1, 1));
-    }
-
-    if (input_[cursor_] == '[') {
+    case CharClass::BeginArray:
+        push_container(false);
         cursor_++; // skip opening bracket
-        expect_next_.push_back(ExpectNext::ArrayValue);
         return Token(Token::Type::Array, input_.substr(cursor_ - 1, 1));
+    default:
+        break;
     }
 
-    // true, false, null, number (or error)
-    const auto value_chars = "0123456789abcdefghijlmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ.+-";
-    auto value_end = input_.find_first_not_of(value_chars, cursor_);
-    if (value_end == std::string::npos) {
-        value_end = input_.size();
+    // true, false, null (or error)
+    auto value_end = cursor_;
+    while (value_end < input_.size() && is_value_char(input_[value_end])) {
+        value_end++;
+    }
+    if (partial_ && value_end == input_.size()) {
+        // The value might continue in the next chunk
+        return end_of_input_token("Expected value");
     }
 
     const auto value = input_.substr(cursor_, value_end - cursor_);
@@ -328,32 +813,25 @@ Token Parser::on_value()
         return Token(Token::Type::Bool, value);
     }
 
-    const auto number_chars = "0123456789eE.-+";
     const auto non_num_pos = value.find_first_not_of(number_chars);
     if (non_num_pos != std::string_view::npos) {
         cursor_ += non_num_pos; // skip to first non-number char
         return error_token("Expected string, array, object, null, boolean or number");
     }
-
-    return number_token(value);
+    // Something like ".5" or "+1"
+    return error_token("Invalid number");
 }
 
 Token Parser::on_object_key()
 {
     skip_whitespace();
     if (cursor_ >= input_.size()) {
-        return error_token("Unterminated object");
-    }
-    if (input_[cursor_] == '}') {
-        cursor_++; // skip closing brace
-        return Token(Token::Type::EndObject, input_.substr(cursor_ - 1, 1));
+        return end_of_input_token("Unterminated object");
     }
-    if (input_[cursor_] == ',') {
-        cursor_++; // skip comma
+    if (input_[cursor_] != '"') {
+        return error_token("Expected string as object key");
     }
-
-    expect_next_.push_back(ExpectNext::ObjectValue);
-
+    state_ = State::ObjectValue;
     return string_token();
 }
 
@@ -361,43 +839,87 @@ Token Parser::on_object_value()
 {
     skip_whitespace();
     if (cursor_ >= input_.size()) {
-        return error_token("Unterminated object");
+        return end_of_input_token("Unterminated object");
     }
     if (input_[cursor_] != ':') {
         return error_token("Expected ':' after object key");
     }
     cursor_++; // skip colon
-
-    expect_next_.push_back(ExpectNext::ObjectKey);
     return on_value();
 }
 
-Token Parser::on_array_value()
+Token Parser::end_container(Token::Type type)
 {
-    // This technically allows leading commas, but I can't come up with an elegant fix
-    skip_whitespace();
-    if (cursor_ >= input_.size()) {
-        return error_token("Unterminated array");
-    }
-    if (input_[cursor_] == ']') {
-        cursor_++; // skip closing bracket
-        return Token(Token::Type::EndArray, input_.substr(cursor_ - 1, 1));
-    }
-    if (input_[cursor_] == ',') {
-        cursor_++; // skip comma
+    assert(depth_ > 0);
+    depth_--;
+    if (depth_ == 0) {
+        after_value_ = State::Done;
+    } else {
+        const auto parent = depth_ - 1;
+        const auto object = (container_word(parent / 64) >> (parent % 64)) & 1;
+        after_value_ = object ? State::ObjectNext : State::ArrayNext;
     }
+    state_ = after_value_;
+    cursor_++; // skip closing bracket or brace
+    return Token(type, input_.substr(cursor_ - 1, 1));
+}
 
-    // After an array value, we expect another array value
-    expect_next_.push_back(ExpectNext::ArrayValue);
+uint64_t& Parser::container_word(size_t word)
+{
+    if (word < containers_.size()) {
+        return containers_[word];
+    }
+    return overflow_containers_[word - containers_.size()];
+}
 
-    return on_value();
+void Parser::push_container(bool object)
+{
+    const auto word = depth_ / 64;
+    const auto bit = uint64_t(1) << (depth_ % 64);
+    if (word >= containers_.size() && word - containers_.size() == overflow_containers_.size()) {
+#ifdef MINIJSON2_STATS
+        stats_.allocations += overflow_containers_.size() == overflow_containers_.capacity();
+#endif
+        overflow_containers_.push_back(0);
+    }
+    auto& bits = container_word(word);
+    bits = object ? bits | bit : bits & ~bit;
+    depth_++;
+#ifdef MINIJSON2_STATS
+    stats_.max_depth = std::max(stats_.max_depth, depth_);
+#endif
+    state_ = object ? State::ObjectStart : State::ArrayStart;
+    after_value_ = object ? State::ObjectNext : State::ArrayNext;
 }
 
 void Parser::skip_whitespace()
 {
-    while (cursor_ < input_.size() && is_whitespace(input_[cursor_])) {
+    // Minified documents have no whitespace at all and the others mostly single spaces, so handle
+    // those without calling into the kernel.
+    if (cursor_ >= input_.size() || !is_whitespace(input_[cursor_])) {
+        return;
+    }
+    if (cursor_ + 1 < input_.size() && !is_whitespace(input_[cursor_ + 1])) {
         cursor_++;
+        return;
+    }
+    if (mode_ == ParseMode::Indexed) {
+        // Every non-whitespace character following whitespace outside of a string is in the index,
+        // so the next entry is exactly where the whitespace ends.
+        cursor_ = next_index_entry() & simd::index_offset_mask;
+        return;
     }
+    cursor_ = simd::skip_whitespace(input_.data(), input_.size(), cursor_);
+}
+
+uint32_t Parser::next_index_entry()
+{
+    // Entries before the cursor have been consumed already. The sentinel at the end of the index
+    // stops this loop.
+    while ((structural_index_[index_pos_] & simd::index_offset_mask) < cursor_) {
+        index_pos_++;
+    }
+    return structural_index_[index_pos_];
 }
 
 Token Parser::string_token()
@@ -405,91 +927,412 @@ Token Parser::string_token()
     skip_whitespace();
     assert(cursor_ < input_.size());
     assert(input_[cursor_] == '"');
-    cursor_++;
-    const auto start = cursor_;
+    const auto quote = cursor_;
+    const auto start = cursor_ + 1;
 
-    auto end = std::string_view::npos;
-    for (size_t i = cursor_; i < input_.size(); ++i) {
-        if (input_[i] == '"' && input_[i - 1] != '\\') {
-            end = i;
-            break;
+    if (mode_ == ParseMode::Indexed) {
+        // If the index says this string is free of escapes and control characters, the closing
+        // quote can be taken from it directly.
+        if (next_index_entry() == quote) {
+            const auto closing = structural_index_[index_pos_ + 1];
+            const auto end = closing & simd::index_offset_mask;
+            // The index does not know about UTF-8, so only ASCII strings can be taken as they are
+            if ((closing & simd::index_closing_quote) && !(closing & simd::index_string_special)
+                && (!options_.validate_utf8
+                    || simd::find_string_special_or_non_ascii(input_.data(), end, start) == end)) {
+                index_pos_ += 2;
+                cursor_ = end + 1; // skip ending double quote
+                return Token(input_.substr(start, end - start), false);
+            }
         }
     }
 
-    if (end == std::string_view::npos) {
-        cursor_--; // Point to starting double quote
-        return error_token("Unterminated string");
-    }
+    // Find the closing quote, validating escape sequences and rejecting control characters on the
+    // way, so the string is only scanned once.
+    auto pos = start;
+    bool has_escapes = false;
+    const auto validate_utf8 = options_.validate_utf8;
+    while (true) {
+        pos = validate_utf8
+            ? simd::find_string_special_or_non_ascii(input_.data(), input_.size(), pos)
+            : simd::find_string_special(input_.data(), input_.size(), pos);
+        if (pos >= input_.size()) {
+            cursor_ = quote; // Point to starting double quote
+            return end_of_input_token("Unterminated string");
+        }
 
-    while (cursor_ < end) {
-        if (input_[cursor_] == '\\') {
-            if (cursor_ + 1 >= input_.size()) {
-                return error_token("Incomplete escape sequence");
-            }
-            cursor_++; // skip backslash
+        const auto ch = input_[pos];
+        if (ch == '"') {
+            break;
+        }
 
-            const auto c = input_[cursor_];
-            if (c == 'u') {
-                cursor_++; // skip 'u'
-                if (cursor_ + 4 >= input_.size()) {
-                    return error_token("Incomplete unicode escape sequence");
+        if (static_cast<unsigned char>(ch) >= 0x80) {
+            // Only stopped here with validate_utf8. Non-ASCII characters usually come in runs, so
+            // validate all of them before going back to the scan.
+            do {
+                size_t error = 0;
+                const auto length = utf8_sequence_length(input_, pos, error);
+                if (length == 0) {
+                    if (error >= input_.size()) {
+                        cursor_ = quote;
+                        return end_of_input_token("Unterminated string");
+                    }
+                    cursor_ = error;
+                    return error_token("Invalid UTF-8 in string");
                 }
-                const auto seq = std::string_view(input_.substr(cursor_, 4));
-                const auto non_hex = seq.find_first_not_of("0123456789abcdefABCDEF");
-                if (non_hex != std::string_view::npos) {
-                    cursor_ += non_hex;
+                pos += length;
+            } while (pos < input_.size() && static_cast<unsigned char>(input_[pos]) >= 0x80);
+            continue;
+        }
+
+        if (ch != '\\') {
+            cursor_ = pos;
+            return error_token("Unescaped control character in string");
+        }
+
+        if (pos + 1 >= input_.size()) {
+            cursor_ = quote;
+            return end_of_input_token("Unterminated string");
+        }
+        pos++; // skip backslash
+        has_escapes = true;
+
+        const auto c = input_[pos];
+        if (c == 'u') {
+            pos++; // skip 'u'
+            if (pos + 4 >= input_.size()) {
+                cursor_ = quote;
+                return end_of_input_token("Unterminated string");
+            }
+            for (size_t i = 0; i < 4; ++i) {
+                if (!is_hex_digit(input_[pos + i])) {
+                    cursor_ = pos + i;
                     return error_token("Incomplete unicode escape sequence");
                 }
-                cursor_ += 4; // skip 4 hex chars
-            } else if (c == '"' || c == '\\' || c == '/' || c == 'b' || c == 'f' || c == 'n'
-                || c == 'r' || c == 't') {
-                cursor_++; // skip escape sequence
-            } else {
-                return error_token("Invalid escape sequence");
             }
+            pos += 4; // skip 4 hex chars
+        } else if (c == '"' || c == '\\' || c == '/' || c == 'b' || c == 'f' || c == 'n' || c == 'r'
+            || c == 't') {
+            pos++; // skip escape sequence
         } else {
-            assert(input_[cursor_] != '"');
-            cursor_++;
+            cursor_ = pos;
+            return error_token("Invalid escape sequence");
         }
     }
-    cursor_++; // skip ending double quote
-    return Token(Token::Type::String, input_.substr(start, end - start));
+    cursor_ = pos + 1; // skip ending double quote
+    return Token(input_.substr(start, pos - start), has_escapes);
 }
 
-Token Parser::number_token(std::string_view value)
+Token Parser::number_token()
 {
-    assert(!value.empty());
-    cursor_ += value.size(); // skip value
+    // Scans, validates and classifies the number and accumulates its digits into a single integer
+    // on the way, so the value is (usually) known right away.
+    const auto data = input_.data();
+    const auto size = input_.size();
+    const auto start = cursor_;
+    auto pos = cursor_;
+
+    const auto negative = data[pos] == '-';
+    if (negative) {
+        pos++;
+    }
+
+    uint64_t mantissa = 0;
+    // Digits after leading zeros, which all have to fit into mantissa
+    size_t significant_digits = 0;
+    const auto add_digit = [&](char ch) {
+        const auto digit = static_cast<uint64_t>(ch - '0');
+        mantissa = mantissa * 10 + digit; // might overflow, but only used if it didn't
+        significant_digits += mantissa != 0;
+    };
+
+    if (pos < size && data[pos] == '0') {
+        pos++; // no leading zeros allowed, so this is the whole integer part
+    } else if (pos < size && is_digit(data[pos])) {
+        while (pos < size && is_digit(data[pos])) {
+            add_digit(data[pos++]);
+        }
+    } else {
+        return invalid_number_token(pos);
+    }
+
+    bool is_float = false;
+    int64_t exponent = 0;
+    if (pos < size && data[pos] == '.') {
+        is_float = true;
+        pos++; // skip decimal point
+        const auto fraction_start = pos;
+        while (pos < size && is_digit(data[pos])) {
+            add_digit(data[pos++]);
+        }
+        if (pos == fraction_start) {
+            return invalid_number_token(pos);
+        }
+        exponent = -static_cast<int64_t>(pos - fraction_start);
+    }
+
+    if (pos < size && (data[pos] | 0x20) == 'e') {
+        is_float = true;
+        pos++; // skip 'e'
+        const auto exponent_negative = pos < size && data[pos] == '-';
+        if (pos < size && (data[pos] == '-' || data[pos] == '+')) {
+            pos++;
+        }
+        const auto exponent_start = pos;
+        int64_t exp = 0;
+        while (pos < size && is_digit(data[pos])) {
+            // Large enough to be infinity or zero anyway
+            if (exp < 100'000) {
+                exp = exp * 10 + (data[pos] - '0');
+            }
+            pos++;
+        }
+        if (pos == exponent_start) {
+            return invalid_number_token(pos);
+        }
+        exponent += exponent_negative ? -exp : exp;
+    }
+
+    if (pos == size && partial_) {
+        // The number might continue in the next chunk
+        return end_of_input_token("Expected value");
+    }
+    if (pos < size && is_value_char(data[pos])) {
+        return invalid_number_token(pos);
+    }
+
+    const auto str = input_.substr(start, pos - start);
+    cursor_ = pos;
+    number_cache_.str = str.data();
+
+    if (!is_float) {
+        // 19 digits always fit, 20 might
+        if (significant_digits > 19) {
+            const auto fits = negative ? parse_number<int64_t>(str).has_value()
+                                       : parse_number<uint64_t>(str).has_value();
+            if (!fits) {
+                // Make it a float instead of failing in parse_int/parse_uint
+                number_cache_.str = nullptr;
+                return Token(Token::Type::Float, str);
+            }
+            if (!negative) {
+                number_cache_.uint = parse_number<uint64_t>(str).value();
+                return Token(Token::Type::UInt, str);
+            }
+        }
+        if (!negative) {
+            number_cache_.uint = mantissa;
+            return Token(Token::Type::UInt, str);
+        }
+        if (mantissa > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) + 1) {
+            number_cache_.str = nullptr;
+            return Token(Token::Type::Float, str);
+        }
+        number_cache_.int_ = static_cast<int64_t>(0 - mantissa);
+        return Token(Token::Type::Int, str);
+    }
+
+    // Clinger's fast path: If the mantissa and the power of ten are exactly representable as
+    // doubles, a single multiplication or division is correctly rounded. This covers most numbers
+    // in practice, everything else is left to std::from_chars.
+    constexpr uint64_t max_exact_mantissa = uint64_t(1) << 53;
+    if (significant_digits <= 19 && mantissa <= max_exact_mantissa && exponent >= -22
+        && exponent <= 22) {
+        auto value = static_cast<double>(mantissa);
+        value = exponent < 0 ? value / powers_of_ten[-exponent] : value * powers_of_ten[exponent];
+        number_cache_.float_ = negative ? -value : value;
+    } else {
+        number_cache_.str = nullptr;
+    }
+    return Token(Token::Type::Float, str);
+}
 
-    const auto int_chars = "0123456789-";
-    if (value.find_first_not_of(int_chars) != std::string_view::npos) {
-        return Token(Token::Type::Float, value);
+Token Parser::invalid_number_token(size_t pos)
+{
+    if (pos >= input_.size()) {
+        cursor_ = input_.size();
+        return end_of_input_token("Invalid number");
     }
-    if (value[0] == '-') {
-        return Token(Token::Type::Int, value);
+    cursor_ = pos;
+    if (is_value_char(input_[pos]) && !is_number_char(input_[pos])) {
+        return error_token("Expected string, array, object, null, boolean or number");
     }
-    return Token(Token::Type::UInt, value);
+    return error_token("Invalid number");
 }
 
 Token Parser::error_token(const char* message)
 {
     // When calling error_token(), cursor_ should always point to the error
-    expect_next_.push_back(ExpectNext::Error); // return errors forever
+    state_ = State::Error; // return errors forever
     error_message_ = message;
     return Token(cursor_, error_message_);
 }
 
+Token Parser::end_of_input_token(const char* message)
+{
+    if (partial_) {
+        need_input_ = true;
+        return Token();
+    }
+    return error_token(message);
+}
+
+namespace {
+    ParseOptions without_index(ParseOptions options)
+    {
+        options.mode = ParseMode::Default;
+        return options;
+    }
+}
+
+StreamParser::StreamParser(bool multiple_documents, ParseOptions options)
+    : parser_(buffer_, without_index(options))
+    , multiple_documents_(multiple_documents)
+{
+    parser_.partial_ = true;
+}
+
+void StreamParser::feed(std::span<const char> chunk)
+{
+    assert(!finished_);
+    // Drop everything that has been consumed already, which is everything before the cursor,
+    // because a NeedInput token resets the cursor to the start of the incomplete token.
+    const auto cursor = parser_.cursor_;
+    buffer_.erase(0, cursor);
+    consumed_ += cursor;
+#ifdef MINIJSON2_STATS
+    parser_.stats_.allocations += buffer_.size() + chunk.size() > buffer_.capacity();
+#endif
+    buffer_.append(chunk.data(), chunk.size());
+
+    parser_.buffer_ = buffer_.data();
+    parser_.input_ = buffer_;
+    parser_.cursor_ = 0;
+}
+
+void StreamParser::finish()
+{
+    finished_ = true;
+    parser_.partial_ = false;
+}
+
+Token StreamParser::next()
+{
+    if (multiple_documents_ && parser_.state_ == Parser::State::Done && !parser_.next_document()
+        && !finished_) {
+        return Token(Token::Type::NeedInput, {});
+    }
+
+    if (parser_.state_ == Parser::State::Done) {
+        return parser_.next(); // Eof
+    }
+
+    const auto cursor = parser_.cursor_;
+    const auto state = parser_.state_;
+    const auto token = parser_.next();
+    if (parser_.need_input_) {
+        // Roll back, so the token can be parsed again once there is more input. Opening and
+        // closing containers never needs more input, so the container stack is still intact.
+        parser_.need_input_ = false;
+        parser_.cursor_ = cursor;
+        parser_.state_ = state;
+        return Token(Token::Type::NeedInput, buffered().substr(cursor));
+    }
+    if (token.type() == Token::Type::Error) {
+        return Token(consumed_ + token.error_location(), token.error_message().data());
+    }
+    return token;
+}
+
+size_t StreamParser::get_location(const Token& token) const
+{
+    return consumed_ + parser_.get_location(token);
+}
+
+std::string_view StreamParser::buffered() const
+{
+    return buffer_;
+}
+
+size_t StreamParser::consumed() const
+{
+    return consumed_;
+}
+
+const ParseStats& StreamParser::stats() const
+{
+    return parser_.stats();
+}
+
+std::string_view StreamParser::parse_string(const Token& token, bool escape_in_place)
+{
+    return parser_.parse_string(token, escape_in_place);
+}
+
+int64_t StreamParser::parse_int(const Token& token)
+{
+    return parser_.parse_int(token);
+}
+
+uint64_t StreamParser::parse_uint(const Token& token)
+{
+    return parser_.parse_uint(token);
+}
+
+double StreamParser::parse_float(const Token& token)
+{
+    return parser_.parse_float(token);
+}
+
+bool StreamParser::parse_bool(const Token& token)
+{
+    return parser_.parse_bool(token);
+}
+
 namespace structread {
-    bool check_type(ParseContext& ctx, const Token& token, const std::string& path,
+    std::string Path::string() const
+    {
+        if (!parent_) {
+            return "";
+        }
+        auto str = parent_->string();
+        if (key_.data()) {
+            str.append(".");
+            str.append(key_);
+        } else {
+            str.append("[");
+            str.append(std::to_string(index_));
+            str.append("]");
+        }
+        return str;
+    }
+
+    bool check_type(ParseContext& ctx, const Token& token, const Path& path,
         Token::Type type, std::string_view type_name)
     {
         if (token.type() != type) {
-            return ctx.set_error(token, concat_string(path, " must be ", type_name));
+            return ctx.set_error(token, concat_string(path.string(), " must be ", type_name));
         }
         return true;
     }
 
-    bool from_json_impl(bool& v, ParseContext& ctx, const Token& token, const std::string& path)
+    size_t count_scalar_array_elements(std::string_view input, size_t array_start)
+    {
+        assert(input[array_start] == '[');
+        const auto data = input.data();
+        const auto start = array_start + 1;
+        const auto end = simd::find_quote_or_bracket(data, input.size(), start);
+        if (end >= input.size() || data[end] != ']') {
+            return 0;
+        }
+        const auto commas = static_cast<size_t>(std::count(data + start, data + end, ','));
+        if (commas == 0 && simd::skip_whitespace(data, end, start) == end) {
+            return 0; // empty array
+        }
+        return commas + 1;
+    }
+
+    bool from_json_impl(bool& v, ParseContext& ctx, const Token& token, const Path& path)
     {
         if (!check_type(ctx, token, path, Token::Type::Bool, "boolean")) {
             return false;
@@ -499,13 +1342,50 @@ namespace structread {
     }
 
     bool from_json_impl(
-        std::string& str, ParseContext& ctx, const Token& token, const std::string& path)
+        std::string& str, ParseContext& ctx, const Token& token, const Path& path)
+    {
+        if (!check_type(ctx, token, path, Token::Type::String, "string")) {
+            return false;
+        }
+        str.assign(ctx.parser.parse_string(token));
+        return true;
+    }
+
+    bool from_json_impl(
+        std::pmr::string& str, ParseContext& ctx, const Token& token, const Path& path)
     {
         if (!check_type(ctx, token, path, Token::Type::String, "string")) {
             return false;
         }
+        use_memory_resource(str, ctx);
         str.assign(ctx.parser.parse_string(token));
         return true;
     }
+
+    bool from_json_impl(
+        std::string_view& str, ParseContext& ctx, const Token& token, const Path& path)
+    {
+        if (!check_type(ctx, token, path, Token::Type::String, "string")) {
+            return false;
+        }
+        const auto value = ctx.parser.parse_string(token);
+        const auto input = ctx.parser.input();
+        const auto in_input = std::greater_equal<const char*>()(value.data(), input.data())
+            && std::less_equal<const char*>()(value.data(), input.data() + input.size());
+        if (in_input) {
+            str = value;
+            return true;
+        }
+        // Escaped into the scratch buffer of a read-only parser
+        if (!ctx.memory_resource) {
+            return ctx.set_error(token,
+                concat_string(path.string(),
+                    " must not contain escape sequences without a memory resource"));
+        }
+        const auto data = static_cast<char*>(ctx.memory_resource->allocate(value.size(), 1));
+        std::memcpy(data, value.data(), value.size());
+        str = std::string_view(data, value.size());
+        return true;
+    }
 }
 }
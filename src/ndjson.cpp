@@ -0,0 +1,168 @@
+#include "minijson2/ndjson.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace minijson2 {
+
+namespace {
+    size_t find_newline(std::span<const char> input, size_t pos)
+    {
+        const auto nl = static_cast<const char*>(
+            std::memchr(input.data() + pos, '\n', input.size() - pos));
+        return nl ? static_cast<size_t>(nl - input.data()) : input.size();
+    }
+}
+
+NdjsonParser::NdjsonParser(NdjsonOptions options) : options_(options)
+{
+    if (options_.num_threads == 0) {
+        options_.num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    contexts_.reserve(options_.num_threads);
+    for (size_t i = 0; i < options_.num_threads; ++i) {
+        contexts_.emplace_back(std::span<char>(), options_.parse_options);
+    }
+    // The calling thread does its share of the work too
+    for (size_t i = 1; i < options_.num_threads; ++i) {
+        threads_.emplace_back(&NdjsonParser::worker, this, i);
+    }
+}
+
+NdjsonParser::~NdjsonParser()
+{
+    {
+        std::lock_guard lock(mutex_);
+        quit_ = true;
+    }
+    job_cv_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+size_t NdjsonParser::num_threads() const
+{
+    return options_.num_threads;
+}
+
+structread::ParseContext& NdjsonParser::context(size_t thread)
+{
+    return contexts_[thread];
+}
+
+size_t NdjsonParser::count_lines(std::span<const char> input, bool end_of_input)
+{
+    size_t num_lines = 0;
+    size_t pos = 0;
+    while (pos < input.size()) {
+        const auto nl = find_newline(input, pos);
+        if (nl == input.size() && !end_of_input) {
+            break;
+        }
+        num_lines++;
+        pos = nl + 1;
+    }
+    return num_lines;
+}
+
+NdjsonResult NdjsonParser::parse(std::span<char> input, bool end_of_input, const Callback& callback)
+{
+    NdjsonResult result;
+
+    // Splitting is done on this thread. Counting newlines is so much faster than parsing, that it
+    // does not get in the way of scaling.
+    batches_.clear();
+    size_t pos = 0;
+    size_t line = 0;
+    while (pos < input.size()) {
+        Batch batch { pos, pos, line };
+        while (pos < input.size() && pos - batch.begin < options_.batch_size) {
+            const auto nl = find_newline(input, pos);
+            if (nl == input.size() && !end_of_input) {
+                break; // partial line
+            }
+            line++;
+            pos = std::min(nl + 1, input.size());
+        }
+        if (pos == batch.begin) {
+            break; // only a partial line left
+        }
+        batch.end = pos;
+        batches_.push_back(batch);
+    }
+    result.consumed = pos;
+    result.num_lines = line;
+
+    input_ = input;
+    callback_ = &callback;
+    next_batch_ = 0;
+    failed_ = false;
+
+    if (!threads_.empty() && batches_.size() > 1) {
+        {
+            std::lock_guard lock(mutex_);
+            job_generation_++;
+            active_workers_ = threads_.size();
+        }
+        job_cv_.notify_all();
+        run_batches(0);
+        std::unique_lock lock(mutex_);
+        done_cv_.wait(lock, [this] { return active_workers_ == 0; });
+    } else {
+        run_batches(0);
+    }
+
+    callback_ = nullptr;
+    result.ok = !failed_;
+    return result;
+}
+
+void NdjsonParser::worker(size_t thread)
+{
+    size_t generation = 0;
+    while (true) {
+        {
+            std::unique_lock lock(mutex_);
+            job_cv_.wait(lock, [&] { return quit_ || job_generation_ != generation; });
+            if (quit_) {
+                return;
+            }
+            generation = job_generation_;
+        }
+
+        run_batches(thread);
+
+        {
+            std::lock_guard lock(mutex_);
+            active_workers_--;
+        }
+        done_cv_.notify_one();
+    }
+}
+
+void NdjsonParser::run_batches(size_t thread)
+{
+    while (!failed_.load(std::memory_order_relaxed)) {
+        const auto batch_index = next_batch_.fetch_add(1, std::memory_order_relaxed);
+        if (batch_index >= batches_.size()) {
+            return;
+        }
+        const auto& batch = batches_[batch_index];
+        auto& context = contexts_[thread];
+        auto line = batch.first_line;
+        auto pos = batch.begin;
+        while (pos < batch.end) {
+            const auto nl = std::min(find_newline(input_, pos), batch.end);
+            context.reset(input_.subspan(pos, nl - pos));
+            if (!(*callback_)(context.parser, line, thread)) {
+                failed_ = true;
+                return;
+            }
+            line++;
+            pos = nl + 1;
+        }
+    }
+}
+
+}
@@ -0,0 +1,441 @@
+#include "minijson2/ondemand.hpp"
+
+#include <limits>
+
+namespace minijson2::ondemand {
+
+Value::Value(Document* document, size_t depth, const char* start)
+    : document_(document)
+    , depth_(depth)
+    , start_(start)
+{
+}
+
+Value::operator bool() const
+{
+    return document_ && document_->locate(*this) != Document::Position::Gone;
+}
+
+Token::Type Value::type() const
+{
+    if (!document_) {
+        return Token::Type::Error;
+    }
+    switch (document_->locate(*this)) {
+    case Document::Position::At:
+        return document_->pending_.type();
+    case Document::Position::Inside:
+        return document_->open_[depth_].token.type();
+    default:
+        return Token::Type::Error;
+    }
+}
+
+const Token* Value::token() const
+{
+    if (!document_ || document_->locate(*this) != Document::Position::At) {
+        return nullptr;
+    }
+    return &document_->pending_;
+}
+
+bool Value::is_null() const
+{
+    const auto tok = token();
+    return tok && tok->type() == Token::Type::Null;
+}
+
+std::optional<bool> Value::get_bool() const
+{
+    const auto tok = token();
+    if (!tok || tok->type() != Token::Type::Bool) {
+        return std::nullopt;
+    }
+    return document_->parser_.parse_bool(*tok);
+}
+
+std::optional<uint64_t> Value::get_uint() const
+{
+    const auto tok = token();
+    if (!tok || tok->type() != Token::Type::UInt) {
+        return std::nullopt;
+    }
+    return document_->parser_.parse_uint(*tok);
+}
+
+std::optional<int64_t> Value::get_int() const
+{
+    const auto tok = token();
+    if (!tok) {
+        return std::nullopt;
+    }
+    if (tok->type() == Token::Type::Int) {
+        return document_->parser_.parse_int(*tok);
+    }
+    if (tok->type() == Token::Type::UInt) {
+        const auto v = document_->parser_.parse_uint(*tok);
+        if (v > static_cast<uint64_t>(std::numeric_limits<int64_t>::max())) {
+            return std::nullopt;
+        }
+        return static_cast<int64_t>(v);
+    }
+    return std::nullopt;
+}
+
+std::optional<double> Value::get_double() const
+{
+    const auto tok = token();
+    if (!tok
+        || (tok->type() != Token::Type::UInt && tok->type() != Token::Type::Int
+            && tok->type() != Token::Type::Float)) {
+        return std::nullopt;
+    }
+    return document_->parser_.parse_float(*tok);
+}
+
+std::optional<std::string_view> Value::get_string() const
+{
+    const auto tok = token();
+    if (!tok || tok->type() != Token::Type::String) {
+        return std::nullopt;
+    }
+    auto& doc = *document_;
+    if (!doc.pending_string_) {
+        doc.pending_string_ = doc.parser_.parse_string(*tok);
+    }
+    return doc.pending_string_;
+}
+
+Value Value::operator[](std::string_view key) const
+{
+    if (!document_) {
+        return Value();
+    }
+    auto& doc = *document_;
+    // The same member again, e.g. the next lookup of a path that starts at the root
+    if (doc.locate(*this) == Document::Position::Inside && doc.open_[depth_].key == key) {
+        if (const auto child = doc.current_child(depth_)) {
+            return child;
+        }
+    }
+    if (!doc.enter(*this, Token::Type::Object) || !doc.discard_pending()) {
+        return Value();
+    }
+    while (const auto member = doc.next_member()) {
+        if (member->key == key) {
+            return member->value;
+        }
+        if (!doc.discard_pending()) {
+            return Value();
+        }
+    }
+    return Value();
+}
+
+Value Value::operator[](size_t index) const
+{
+    if (!document_) {
+        return Value();
+    }
+    auto& doc = *document_;
+    if (doc.locate(*this) == Document::Position::Inside && doc.open_[depth_].index == index + 1) {
+        if (const auto child = doc.current_child(depth_)) {
+            return child;
+        }
+    }
+    if (!doc.enter(*this, Token::Type::Array)) {
+        return Value();
+    }
+    const auto num_read = doc.open_.back().index;
+    // Already passed
+    if (index < num_read) {
+        return Value();
+    }
+    while (true) {
+        if (!doc.discard_pending()) {
+            return Value();
+        }
+        const auto elem = doc.next_element();
+        if (!elem || doc.open_.back().index == index + 1) {
+            return elem;
+        }
+    }
+}
+
+Range<ArrayIterator> Value::elements() const
+{
+    return { ArrayIterator(*this), ArrayIterator() };
+}
+
+Range<ObjectIterator> Value::members() const
+{
+    return { ObjectIterator(*this), ObjectIterator() };
+}
+
+ArrayIterator::ArrayIterator(Value array)
+{
+    if (!array.document_) {
+        return;
+    }
+    auto& doc = *array.document_;
+    // Continue with the element that was accessed last
+    if (doc.locate(array) == Document::Position::Inside) {
+        element_ = doc.current_child(array.depth_);
+    }
+    if (!element_) {
+        if (!doc.enter(array, Token::Type::Array) || !doc.discard_pending()) {
+            return;
+        }
+        element_ = doc.next_element();
+    }
+    if (element_) {
+        array_ = array;
+    }
+}
+
+ArrayIterator& ArrayIterator::operator++()
+{
+    auto& doc = *array_.document_;
+    if (doc.seek(array_) != Document::Position::Inside || !doc.discard_pending()) {
+        *this = ArrayIterator();
+        return *this;
+    }
+    element_ = doc.next_element();
+    if (!element_) {
+        *this = ArrayIterator();
+    }
+    return *this;
+}
+
+bool ArrayIterator::operator==(const ArrayIterator& other) const
+{
+    return array_.document_ == other.array_.document_ && element_.start_ == other.element_.start_;
+}
+
+ObjectIterator::ObjectIterator(Value object)
+{
+    if (!object.document_) {
+        return;
+    }
+    auto& doc = *object.document_;
+    if (doc.locate(object) == Document::Position::Inside) {
+        member_ = Member { doc.open_[object.depth_].key, doc.current_child(object.depth_) };
+    }
+    if (!member_.value) {
+        if (!doc.enter(object, Token::Type::Object) || !doc.discard_pending()) {
+            return;
+        }
+        const auto member = doc.next_member();
+        if (!member) {
+            return;
+        }
+        member_ = *member;
+    }
+    object_ = object;
+}
+
+ObjectIterator& ObjectIterator::operator++()
+{
+    auto& doc = *object_.document_;
+    if (doc.seek(object_) != Document::Position::Inside || !doc.discard_pending()) {
+        *this = ObjectIterator();
+        return *this;
+    }
+    const auto member = doc.next_member();
+    if (!member) {
+        *this = ObjectIterator();
+        return *this;
+    }
+    member_ = *member;
+    return *this;
+}
+
+bool ObjectIterator::operator==(const ObjectIterator& other) const
+{
+    return object_.document_ == other.object_.document_
+        && member_.value.start_ == other.member_.value.start_;
+}
+
+Document::Document(std::string& input, ParseOptions options) : parser_(input, options)
+{
+    init();
+}
+
+Document::Document(std::span<char> input, ParseOptions options) : parser_(input, options)
+{
+    init();
+}
+
+Document::Document(std::string_view input, std::string& scratch, ParseOptions options)
+    : parser_(input, scratch, options)
+{
+    init();
+}
+
+void Document::init()
+{
+    // Lookups rarely go deeper than this
+    open_.reserve(8);
+    const auto token = parser_.next();
+    if (token.type() == Token::Type::Error) {
+        fail(token);
+        return;
+    }
+    set_pending(token);
+    root_ = token.string().data();
+}
+
+Value Document::root()
+{
+    if (!root_) {
+        return Value();
+    }
+    return Value(this, 0, root_);
+}
+
+bool Document::failed() const
+{
+    return failed_;
+}
+
+const Token& Document::error() const
+{
+    return error_;
+}
+
+const Parser& Document::parser() const
+{
+    return parser_;
+}
+
+Document::Position Document::locate(const Value& value) const
+{
+    if (failed_ || value.document_ != this) {
+        return Position::Gone;
+    }
+    if (value.depth_ < open_.size()) {
+        return open_[value.depth_].token.string().data() == value.start_ ? Position::Inside
+                                                                         : Position::Gone;
+    }
+    if (has_pending_ && value.depth_ == open_.size() && pending_.string().data() == value.start_) {
+        return Position::At;
+    }
+    return Position::Gone;
+}
+
+Document::Position Document::seek(const Value& value)
+{
+    const auto pos = locate(value);
+    if (pos != Position::Inside) {
+        return pos;
+    }
+    while (open_.size() > value.depth_ + 1) {
+        // Skipping the container token jumps to the end of that container, even if some of its
+        // elements have been read already.
+        if (!discard_pending() || !parser_.skip(open_.back().token)) {
+            fail(parser_.next());
+            return Position::Gone;
+        }
+        open_.pop_back();
+    }
+    return Position::Inside;
+}
+
+Value Document::current_child(size_t depth)
+{
+    if (open_.size() > depth + 1) {
+        return Value(this, depth + 1, open_[depth + 1].token.string().data());
+    }
+    if (has_pending_ && open_.size() == depth + 1) {
+        return Value(this, depth + 1, pending_.string().data());
+    }
+    return Value();
+}
+
+bool Document::enter(const Value& value, Token::Type type)
+{
+    const auto pos = seek(value);
+    if (pos == Position::At) {
+        if (pending_.type() != type) {
+            return false;
+        }
+        open_.push_back(Container { pending_, 0, {} });
+        has_pending_ = false;
+        return true;
+    }
+    return pos == Position::Inside && open_.back().token.type() == type;
+}
+
+void Document::set_pending(const Token& token)
+{
+    pending_ = token;
+    has_pending_ = true;
+    pending_string_.reset();
+}
+
+bool Document::discard_pending()
+{
+    if (!has_pending_) {
+        return true;
+    }
+    has_pending_ = false;
+    if (!parser_.skip(pending_)) {
+        return fail(parser_.next());
+    }
+    return true;
+}
+
+Value Document::next_element()
+{
+    const auto token = parser_.next();
+    if (token.type() == Token::Type::EndArray) {
+        open_.pop_back();
+        return Value();
+    }
+    if (token.type() == Token::Type::Error) {
+        fail(token);
+        return Value();
+    }
+    set_pending(token);
+    open_.back().index++;
+    return Value(this, open_.size(), token.string().data());
+}
+
+std::optional<Member> Document::next_member()
+{
+    const auto key_token = parser_.next();
+    if (key_token.type() == Token::Type::EndObject) {
+        open_.pop_back();
+        return std::nullopt;
+    }
+    if (key_token.type() == Token::Type::Error) {
+        fail(key_token);
+        return std::nullopt;
+    }
+    auto key = parser_.parse_string(key_token);
+    if (key_token.has_escapes()) {
+        if (escaped_keys_.size() < open_.size()) {
+            escaped_keys_.resize(open_.size());
+        }
+        key = escaped_keys_[open_.size() - 1].assign(key);
+    }
+    const auto token = parser_.next();
+    if (token.type() == Token::Type::Error) {
+        fail(token);
+        return std::nullopt;
+    }
+    set_pending(token);
+    open_.back().key = key;
+    return Member { key, Value(this, open_.size(), token.string().data()) };
+}
+
+bool Document::fail(const Token& token)
+{
+    if (!failed_) {
+        error_ = token;
+        failed_ = true;
+    }
+    return false;
+}
+
+}
@@ -0,0 +1,132 @@
+#include "minijson2/parallel.hpp"
+
+#include <algorithm>
+#include <thread>
+
+#include "simd.hpp"
+
+namespace minijson2 {
+
+namespace {
+    bool is_whitespace(char ch)
+    {
+        return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+    }
+}
+
+bool find_array_elements(std::string_view input, std::vector<ArrayElement>& elements)
+{
+    const auto data = input.data();
+    const auto size = input.size();
+    elements.clear();
+
+    auto pos = simd::skip_whitespace(data, size, 0);
+    if (pos >= size || data[pos] != '[') {
+        return false;
+    }
+    pos = simd::skip_whitespace(data, size, pos + 1);
+    if (pos < size && data[pos] == ']') {
+        return true; // empty array
+    }
+
+    size_t depth = 0; // relative to the top-level array
+    size_t start = std::string_view::npos; // of the current element
+    // At depth 0 a value is complete, so only whitespace, ',' or ']' may follow, just like in the
+    // parser. Otherwise an element could contain two values, which the parser would not notice,
+    // because it only ever sees one element.
+    bool complete = false;
+    while (pos < size) {
+        const auto ch = data[pos];
+        if (depth == 0) {
+            if (is_whitespace(ch)) {
+                complete = start != std::string_view::npos;
+                pos++;
+                continue;
+            }
+            if (ch == ',' || ch == ']') {
+                if (start == std::string_view::npos) {
+                    return false; // empty element
+                }
+                elements.push_back({ start, pos });
+                if (ch == ']') {
+                    return true;
+                }
+                start = std::string_view::npos;
+                complete = false;
+                pos++;
+                continue;
+            }
+            if (complete) {
+                return false;
+            }
+            if (start == std::string_view::npos) {
+                start = pos;
+            } else if (ch == '"' || ch == '[' || ch == '{') {
+                return false; // these have to start a value
+            }
+        }
+
+        switch (ch) {
+        case '"':
+            pos++; // skip opening quote
+            while (true) {
+                pos = simd::find_string_special(data, size, pos);
+                if (pos >= size || static_cast<unsigned char>(data[pos]) < 0x20) {
+                    return false;
+                }
+                if (data[pos] == '"') {
+                    break;
+                }
+                pos += 2; // skip escaped character
+            }
+            complete = depth == 0;
+            break;
+        case '[':
+        case '{':
+            depth++;
+            break;
+        case ']':
+        case '}':
+            if (depth == 0) {
+                return false;
+            }
+            depth--;
+            complete = depth == 0;
+            break;
+        default:
+            break;
+        }
+        pos++;
+        if (depth > 0) {
+            // Inside of an element, only strings and brackets matter
+            pos = simd::find_quote_or_bracket(data, size, pos);
+        }
+    }
+    return false; // unterminated array
+}
+
+void parallel_for(size_t num_tasks, size_t num_threads, const std::function<void(size_t)>& func)
+{
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    num_threads = std::min(num_threads, num_tasks);
+
+    std::atomic<size_t> next_task = 0;
+    const auto run = [&] {
+        for (auto task = next_task++; task < num_tasks; task = next_task++) {
+            func(task);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_threads; ++i) {
+        threads.emplace_back(run);
+    }
+    run();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+}
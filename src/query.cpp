@@ -0,0 +1,261 @@
+#include "minijson2/query.hpp"
+
+#include <cassert>
+#include <charconv>
+
+namespace minijson2 {
+
+namespace {
+    // Decimal without leading zeros, like RFC 6901 requires for array indices
+    std::optional<size_t> parse_index(std::string_view str)
+    {
+        if (str.empty() || (str.size() > 1 && str[0] == '0')) {
+            return std::nullopt;
+        }
+        size_t index = 0;
+        const auto res = std::from_chars(str.data(), str.data() + str.size(), index);
+        if (res.ec != std::errc() || res.ptr != str.data() + str.size()) {
+            return std::nullopt;
+        }
+        return index;
+    }
+
+    bool is_identifier_char(char ch)
+    {
+        return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9')
+            || ch == '_' || ch == '-' || ch == '$' || static_cast<unsigned char>(ch) >= 0x80;
+    }
+}
+
+std::optional<Query> Query::pointer(std::string_view pointer)
+{
+    Query query;
+    if (pointer.empty()) {
+        return query;
+    }
+    if (pointer[0] != '/') {
+        return std::nullopt;
+    }
+    size_t pos = 1;
+    while (true) {
+        const auto end = std::min(pointer.find('/', pos), pointer.size());
+        std::string key;
+        for (size_t i = pos; i < end; ++i) {
+            if (pointer[i] != '~') {
+                key.push_back(pointer[i]);
+                continue;
+            }
+            if (i + 1 >= end || (pointer[i + 1] != '0' && pointer[i + 1] != '1')) {
+                return std::nullopt;
+            }
+            key.push_back(pointer[i + 1] == '0' ? '~' : '/');
+            i++;
+        }
+        Segment segment;
+        segment.index = parse_index(key);
+        segment.key = std::move(key);
+        query.segments_.push_back(std::move(segment));
+        if (end == pointer.size()) {
+            return query;
+        }
+        pos = end + 1;
+    }
+}
+
+std::optional<Query> Query::path(std::string_view path)
+{
+    if (path.empty() || path[0] != '$') {
+        return std::nullopt;
+    }
+    Query query;
+    size_t pos = 1;
+    while (pos < path.size()) {
+        Segment segment;
+        if (path[pos] == '.') {
+            pos++;
+            if (pos < path.size() && path[pos] == '*') {
+                segment.wildcard = true;
+                pos++;
+            } else {
+                const auto start = pos;
+                while (pos < path.size() && is_identifier_char(path[pos])) {
+                    pos++;
+                }
+                if (pos == start) {
+                    return std::nullopt;
+                }
+                segment.key = std::string(path.substr(start, pos - start));
+            }
+        } else if (path[pos] == '[') {
+            pos++;
+            if (pos >= path.size()) {
+                return std::nullopt;
+            }
+            if (path[pos] == '*') {
+                segment.wildcard = true;
+                pos++;
+            } else if (path[pos] == '\'' || path[pos] == '"') {
+                const auto quote = path[pos];
+                pos++;
+                std::string key;
+                while (pos < path.size() && path[pos] != quote) {
+                    if (path[pos] == '\\') {
+                        pos++;
+                        if (pos >= path.size()) {
+                            return std::nullopt;
+                        }
+                    }
+                    key.push_back(path[pos]);
+                    pos++;
+                }
+                if (pos >= path.size()) {
+                    return std::nullopt;
+                }
+                pos++; // skip closing quote
+                segment.key = std::move(key);
+            } else {
+                const auto end = path.find(']', pos);
+                if (end == std::string_view::npos) {
+                    return std::nullopt;
+                }
+                segment.index = parse_index(path.substr(pos, end - pos));
+                if (!segment.index) {
+                    return std::nullopt;
+                }
+                pos = end;
+            }
+            if (pos >= path.size() || path[pos] != ']') {
+                return std::nullopt;
+            }
+            pos++; // skip closing bracket
+        } else {
+            return std::nullopt;
+        }
+        query.segments_.push_back(std::move(segment));
+    }
+    return query;
+}
+
+const std::vector<Query::Segment>& Query::segments() const
+{
+    return segments_;
+}
+
+Query::Matcher::Matcher(const Query& query, Parser& parser) : Matcher(query)
+{
+    parser_ = &parser;
+}
+
+Query::Matcher::Matcher(const Query& query) : query_(&query), parser_(nullptr)
+{
+    frames_.reserve(query.segments().size());
+    for (const auto& segment : query.segments()) {
+        single_value_ = single_value_ && !segment.wildcard;
+    }
+}
+
+void Query::Matcher::reset(Parser& parser)
+{
+    parser_ = &parser;
+    frames_.clear();
+    started_ = false;
+    finished_ = false;
+}
+
+bool Query::Matcher::matches_type(size_t segment, Token::Type type) const
+{
+    const auto& seg = query_->segments_[segment];
+    if (type == Token::Type::Object) {
+        return seg.wildcard || seg.key;
+    }
+    if (type == Token::Type::Array) {
+        return seg.wildcard || seg.index;
+    }
+    return false;
+}
+
+Token Query::Matcher::next()
+{
+    assert(parser_);
+    auto& parser = *parser_;
+    const auto& segments = query_->segments_;
+    const auto eof = Token(Token::Type::Eof, parser.input().substr(parser.input().size()));
+
+    if (finished_) {
+        return eof;
+    }
+    if (!started_) {
+        started_ = true;
+        const auto root = parser.next();
+        if (root.type() == Token::Type::Error || segments.empty()) {
+            finished_ = true;
+            return root;
+        }
+        if (!matches_type(0, root.type())) {
+            if (!parser.skip(root)) {
+                return parser.next();
+            }
+        } else {
+            frames_.push_back(Frame { root, 0 });
+        }
+    }
+
+    while (!frames_.empty()) {
+        auto& frame = frames_.back();
+        if (frame.done) {
+            // Skipping the container token jumps to its end, even if it has been read partially
+            if (!parser.skip(frame.container)) {
+                return parser.next();
+            }
+            frames_.pop_back();
+            continue;
+        }
+
+        const auto& segment = segments[frame.segment];
+        Token value;
+        bool match = false;
+        if (frame.container.type() == Token::Type::Object) {
+            const auto key = parser.next();
+            if (key.type() == Token::Type::EndObject) {
+                frames_.pop_back();
+                continue;
+            }
+            if (key.type() == Token::Type::Error) {
+                return key;
+            }
+            match = segment.wildcard || *segment.key == parser.parse_string(key);
+            value = parser.next();
+        } else {
+            value = parser.next();
+            if (value.type() == Token::Type::EndArray) {
+                frames_.pop_back();
+                continue;
+            }
+            match = segment.wildcard || *segment.index == frame.index;
+            frame.index++;
+        }
+        if (value.type() == Token::Type::Error) {
+            return value;
+        }
+
+        if (match && !segment.wildcard) {
+            frame.done = true;
+        }
+        const auto next_segment = frame.segment + 1;
+        if (match && next_segment == segments.size()) {
+            finished_ = single_value_;
+            return value;
+        }
+        if (match && matches_type(next_segment, value.type())) {
+            // Invalidates frame
+            frames_.push_back(Frame { value, next_segment });
+            continue;
+        }
+        if (!parser.skip(value)) {
+            return parser.next();
+        }
+    }
+    return eof;
+}
+
+}
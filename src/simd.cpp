@@ -0,0 +1,725 @@
+#include "simd.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+
+#if !defined(MINIJSON2_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64))
+#define MINIJSON2_SIMD_X86
+#include <immintrin.h>
+#elif !defined(MINIJSON2_NO_SIMD) && defined(__aarch64__)
+#define MINIJSON2_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+using namespace minijson2::simd;
+
+bool is_whitespace(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+bool is_string_special(char ch)
+{
+    return ch == '"' || ch == '\\' || static_cast<unsigned char>(ch) < 0x20;
+}
+
+size_t find_string_special_scalar(const char* data, size_t size, size_t pos)
+{
+    while (pos < size && !is_string_special(data[pos])) {
+        pos++;
+    }
+    return pos;
+}
+
+size_t find_string_special_or_non_ascii_scalar(const char* data, size_t size, size_t pos)
+{
+    while (pos < size && !is_string_special(data[pos])
+        && static_cast<unsigned char>(data[pos]) < 0x80) {
+        pos++;
+    }
+    return pos;
+}
+
+bool is_quote_or_bracket(char ch)
+{
+    return ch == '"' || ch == '[' || ch == ']' || ch == '{' || ch == '}';
+}
+
+size_t find_quote_or_bracket_scalar(const char* data, size_t size, size_t pos)
+{
+    while (pos < size && !is_quote_or_bracket(data[pos])) {
+        pos++;
+    }
+    return pos;
+}
+
+size_t skip_whitespace_scalar(const char* data, size_t size, size_t pos)
+{
+    while (pos < size && is_whitespace(data[pos])) {
+        pos++;
+    }
+    return pos;
+}
+
+#if defined(MINIJSON2_SIMD_X86)
+// SSE2 is part of x86-64, so it is always available and only AVX2 needs to be detected at runtime.
+__m128i string_special_mask_sse2(__m128i v)
+{
+    const auto quote = _mm_cmpeq_epi8(v, _mm_set1_epi8('"'));
+    const auto backslash = _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'));
+    // There is no unsigned comparison, but min(v, 0x1F) == v is the same as v <= 0x1F.
+    const auto control = _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1F)), v);
+    return _mm_or_si128(_mm_or_si128(quote, backslash), control);
+}
+
+__m128i whitespace_mask_sse2(__m128i v)
+{
+    const auto space = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    const auto tab = _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'));
+    const auto lf = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+    const auto cr = _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'));
+    return _mm_or_si128(_mm_or_si128(space, tab), _mm_or_si128(lf, cr));
+}
+
+size_t find_string_special_sse2(const char* data, size_t size, size_t pos)
+{
+    while (pos + 16 <= size) {
+        const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(string_special_mask_sse2(v)));
+        if (mask) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 16;
+    }
+    return find_string_special_scalar(data, size, pos);
+}
+
+// movemask takes the high bit of every byte, which is exactly the non-ASCII ones
+size_t find_string_special_or_non_ascii_sse2(const char* data, size_t size, size_t pos)
+{
+    while (pos + 16 <= size) {
+        const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        const auto mask = static_cast<uint32_t>(
+            _mm_movemask_epi8(_mm_or_si128(string_special_mask_sse2(v), v)));
+        if (mask) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 16;
+    }
+    return find_string_special_or_non_ascii_scalar(data, size, pos);
+}
+
+size_t skip_whitespace_sse2(const char* data, size_t size, size_t pos)
+{
+    while (pos + 16 <= size) {
+        const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        const auto ws = static_cast<uint32_t>(_mm_movemask_epi8(whitespace_mask_sse2(v)));
+        const auto mask = ~ws & 0xFFFF;
+        if (mask) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 16;
+    }
+    return skip_whitespace_scalar(data, size, pos);
+}
+
+// '[' and ']' are '{' and '}' without the 0x20 bit
+__m128i quote_or_bracket_mask_sse2(__m128i v)
+{
+    const auto quote = _mm_cmpeq_epi8(v, _mm_set1_epi8('"'));
+    const auto lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    const auto open = _mm_cmpeq_epi8(lower, _mm_set1_epi8('{'));
+    const auto close = _mm_cmpeq_epi8(lower, _mm_set1_epi8('}'));
+    return _mm_or_si128(quote, _mm_or_si128(open, close));
+}
+
+size_t find_quote_or_bracket_sse2(const char* data, size_t size, size_t pos)
+{
+    while (pos + 16 <= size) {
+        const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(quote_or_bracket_mask_sse2(v)));
+        if (mask) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 16;
+    }
+    return find_quote_or_bracket_scalar(data, size, pos);
+}
+
+__attribute__((target("avx2"))) size_t find_string_special_avx2(
+    const char* data, size_t size, size_t pos)
+{
+    while (pos + 32 <= size) {
+        const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        const auto quote = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'));
+        const auto backslash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'));
+        const auto control = _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x1F)), v);
+        const auto special = _mm256_or_si256(_mm256_or_si256(quote, backslash), control);
+        const auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(special));
+        if (mask) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 32;
+    }
+    // The tail is legacy SSE code, which is very slow while the upper halves of the ymm registers
+    // are dirty. GCC does not insert vzeroupper before the tail call, so do it explicitly.
+    _mm256_zeroupper();
+    return find_string_special_sse2(data, size, pos);
+}
+
+__attribute__((target("avx2"))) size_t find_string_special_or_non_ascii_avx2(
+    const char* data, size_t size, size_t pos)
+{
+    while (pos + 32 <= size) {
+        const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        const auto quote = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'));
+        const auto backslash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'));
+        const auto control = _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x1F)), v);
+        const auto special = _mm256_or_si256(_mm256_or_si256(quote, backslash), control);
+        const auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(special, v)));
+        if (mask) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 32;
+    }
+    _mm256_zeroupper(); // see find_string_special_avx2
+    return find_string_special_or_non_ascii_sse2(data, size, pos);
+}
+
+__attribute__((target("avx2"))) size_t skip_whitespace_avx2(
+    const char* data, size_t size, size_t pos)
+{
+    while (pos + 32 <= size) {
+        const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        const auto space = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+        const auto tab = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'));
+        const auto lf = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+        const auto cr = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'));
+        const auto ws = _mm256_or_si256(_mm256_or_si256(space, tab), _mm256_or_si256(lf, cr));
+        const auto mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(ws));
+        if (mask) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 32;
+    }
+    _mm256_zeroupper(); // see find_string_special_avx2
+    return skip_whitespace_sse2(data, size, pos);
+}
+
+__attribute__((target("avx2"))) size_t find_quote_or_bracket_avx2(
+    const char* data, size_t size, size_t pos)
+{
+    while (pos + 32 <= size) {
+        const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        const auto quote = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'));
+        const auto lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        const auto open = _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('{'));
+        const auto close = _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('}'));
+        const auto special = _mm256_or_si256(quote, _mm256_or_si256(open, close));
+        const auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(special));
+        if (mask) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 32;
+    }
+    _mm256_zeroupper(); // see find_string_special_avx2
+    return find_quote_or_bracket_sse2(data, size, pos);
+}
+
+bool has_avx2()
+{
+    return __builtin_cpu_supports("avx2");
+}
+#endif
+
+#if defined(MINIJSON2_SIMD_NEON)
+// NEON has no movemask, so narrow the 0x00/0xFF bytes to nibbles and get a 64 bit mask with 4 bits
+// per byte instead.
+uint64_t nibble_mask_neon(uint8x16_t cmp)
+{
+    const auto narrowed = vshrn_n_u16(vreinterpretq_u16_u8(cmp), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(narrowed), 0);
+}
+
+size_t find_string_special_neon(const char* data, size_t size, size_t pos)
+{
+    while (pos + 16 <= size) {
+        const auto v = vld1q_u8(reinterpret_cast<const uint8_t*>(data + pos));
+        const auto quote = vceqq_u8(v, vdupq_n_u8('"'));
+        const auto backslash = vceqq_u8(v, vdupq_n_u8('\\'));
+        const auto control = vcltq_u8(v, vdupq_n_u8(0x20));
+        const auto mask = nibble_mask_neon(vorrq_u8(vorrq_u8(quote, backslash), control));
+        if (mask) {
+            return pos + __builtin_ctzll(mask) / 4;
+        }
+        pos += 16;
+    }
+    return find_string_special_scalar(data, size, pos);
+}
+
+size_t find_string_special_or_non_ascii_neon(const char* data, size_t size, size_t pos)
+{
+    while (pos + 16 <= size) {
+        const auto v = vld1q_u8(reinterpret_cast<const uint8_t*>(data + pos));
+        const auto quote = vceqq_u8(v, vdupq_n_u8('"'));
+        const auto backslash = vceqq_u8(v, vdupq_n_u8('\\'));
+        // Control characters and non-ASCII bytes are the ones outside of [0x20, 0x7F]
+        const auto outside = vcgtq_u8(vsubq_u8(v, vdupq_n_u8(0x20)), vdupq_n_u8(0x5F));
+        const auto mask = nibble_mask_neon(vorrq_u8(vorrq_u8(quote, backslash), outside));
+        if (mask) {
+            return pos + __builtin_ctzll(mask) / 4;
+        }
+        pos += 16;
+    }
+    return find_string_special_or_non_ascii_scalar(data, size, pos);
+}
+
+size_t find_quote_or_bracket_neon(const char* data, size_t size, size_t pos)
+{
+    while (pos + 16 <= size) {
+        const auto v = vld1q_u8(reinterpret_cast<const uint8_t*>(data + pos));
+        const auto quote = vceqq_u8(v, vdupq_n_u8('"'));
+        const auto lower = vorrq_u8(v, vdupq_n_u8(0x20));
+        const auto open = vceqq_u8(lower, vdupq_n_u8('{'));
+        const auto close = vceqq_u8(lower, vdupq_n_u8('}'));
+        const auto mask = nibble_mask_neon(vorrq_u8(quote, vorrq_u8(open, close)));
+        if (mask) {
+            return pos + __builtin_ctzll(mask) / 4;
+        }
+        pos += 16;
+    }
+    return find_quote_or_bracket_scalar(data, size, pos);
+}
+
+size_t skip_whitespace_neon(const char* data, size_t size, size_t pos)
+{
+    while (pos + 16 <= size) {
+        const auto v = vld1q_u8(reinterpret_cast<const uint8_t*>(data + pos));
+        const auto space = vceqq_u8(v, vdupq_n_u8(' '));
+        const auto tab = vceqq_u8(v, vdupq_n_u8('\t'));
+        const auto lf = vceqq_u8(v, vdupq_n_u8('\n'));
+        const auto cr = vceqq_u8(v, vdupq_n_u8('\r'));
+        const auto ws = vorrq_u8(vorrq_u8(space, tab), vorrq_u8(lf, cr));
+        const auto mask = nibble_mask_neon(vmvnq_u8(ws));
+        if (mask) {
+            return pos + __builtin_ctzll(mask) / 4;
+        }
+        pos += 16;
+    }
+    return skip_whitespace_scalar(data, size, pos);
+}
+#endif
+
+// Bitmasks (one bit per byte) of the character classes in a 64 byte block
+struct BlockMasks {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t whitespace;
+    uint64_t op; // ,:[]{}
+    uint64_t control;
+};
+
+#if defined(MINIJSON2_SIMD_X86)
+BlockMasks classify_block(const char* block)
+{
+    const auto movemask = [](__m128i v) {
+        return static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(v)));
+    };
+    BlockMasks masks {};
+    for (size_t i = 0; i < 4; ++i) {
+        const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i * 16));
+        const auto eq = [v](char ch) { return _mm_cmpeq_epi8(v, _mm_set1_epi8(ch)); };
+        const auto shift = i * 16;
+        masks.quote |= movemask(eq('"')) << shift;
+        masks.backslash |= movemask(eq('\\')) << shift;
+        masks.whitespace |= movemask(whitespace_mask_sse2(v)) << shift;
+        // '[' and ']' are '{' and '}' without bit 5 set
+        const auto lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        const auto brackets = _mm_or_si128(_mm_cmpeq_epi8(lower, _mm_set1_epi8('{')),
+            _mm_cmpeq_epi8(lower, _mm_set1_epi8('}')));
+        const auto op = _mm_or_si128(_mm_or_si128(eq(','), eq(':')), brackets);
+        masks.op |= movemask(op) << shift;
+        masks.control |= movemask(_mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1F)), v)) << shift;
+    }
+    return masks;
+}
+#elif defined(MINIJSON2_SIMD_NEON)
+BlockMasks classify_block(const char* block)
+{
+    // Give every lane its bit value and sum each half to get a proper 16 bit mask
+    static const uint8_t bit_values[16]
+        = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    const auto bitmask = [](uint8x16_t cmp) {
+        const auto bits = vandq_u8(cmp, vld1q_u8(bit_values));
+        const auto lo = static_cast<uint64_t>(vaddv_u8(vget_low_u8(bits)));
+        const auto hi = static_cast<uint64_t>(vaddv_u8(vget_high_u8(bits)));
+        return lo | (hi << 8);
+    };
+    BlockMasks masks {};
+    for (size_t i = 0; i < 4; ++i) {
+        const auto v = vld1q_u8(reinterpret_cast<const uint8_t*>(block + i * 16));
+        const auto eq = [v](char ch) { return vceqq_u8(v, vdupq_n_u8(ch)); };
+        const auto shift = i * 16;
+        masks.quote |= bitmask(eq('"')) << shift;
+        masks.backslash |= bitmask(eq('\\')) << shift;
+        const auto ws = vorrq_u8(vorrq_u8(eq(' '), eq('\t')), vorrq_u8(eq('\n'), eq('\r')));
+        masks.whitespace |= bitmask(ws) << shift;
+        const auto op = vorrq_u8(vorrq_u8(vorrq_u8(eq(','), eq(':')), vorrq_u8(eq('['), eq(']'))),
+            vorrq_u8(eq('{'), eq('}')));
+        masks.op |= bitmask(op) << shift;
+        masks.control |= bitmask(vcltq_u8(v, vdupq_n_u8(0x20))) << shift;
+    }
+    return masks;
+}
+#endif
+
+BlockMasks classify_block_scalar(const char* block)
+{
+    BlockMasks masks {};
+    for (size_t i = 0; i < 64; ++i) {
+        const auto ch = block[i];
+        const auto bit = uint64_t(1) << i;
+        masks.quote |= ch == '"' ? bit : 0;
+        masks.backslash |= ch == '\\' ? bit : 0;
+        masks.whitespace |= is_whitespace(ch) ? bit : 0;
+        const auto op = ch == ',' || ch == ':' || ch == '[' || ch == ']' || ch == '{' || ch == '}';
+        masks.op |= op ? bit : 0;
+        masks.control |= static_cast<unsigned char>(ch) < 0x20 ? bit : 0;
+    }
+    return masks;
+}
+
+// Every bit is the xor of itself and all bits below it. For a quote mask this gives a mask that is
+// set from an opening quote up to (excluding) the closing quote.
+uint64_t prefix_xor(uint64_t bits)
+{
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+// Returns a mask of the characters preceded by an odd number of backslashes, i.e. the characters
+// that are escaped. prev_escaped carries whether the first character of the next block is escaped.
+// This is the branchless algorithm from simdjson.
+uint64_t find_escaped(uint64_t backslash, uint64_t& prev_escaped)
+{
+    backslash &= ~prev_escaped;
+    const auto follows_escape = backslash << 1 | prev_escaped;
+    constexpr uint64_t even_bits = 0x5555'5555'5555'5555;
+    const auto odd_sequence_starts = backslash & ~even_bits & ~follows_escape;
+    uint64_t sequences_starting_on_even_bits = 0;
+    prev_escaped = __builtin_add_overflow(
+        odd_sequence_starts, backslash, &sequences_starting_on_even_bits);
+    const auto invert_mask = sequences_starting_on_even_bits << 1;
+    return (even_bits ^ invert_mask) & follows_escape;
+}
+
+// always_inline, so the target specific classify functions can be inlined into the wrappers below
+template <BlockMasks (*Classify)(const char*)>
+__attribute__((always_inline)) inline void build_structural_index_impl(
+    const char* data, size_t size, std::vector<uint32_t>& index)
+{
+    assert(size <= max_indexed_size);
+    index.clear();
+    // A rough guess for the number of tokens to avoid most reallocations
+    index.reserve(size / 8 + 1);
+
+    uint64_t prev_escaped = 0;
+    uint64_t prev_in_string = 0;
+    uint64_t prev_boundary = 1; // The start of the input is a token boundary
+    bool string_special = false;
+    for (size_t base = 0; base < size; base += 64) {
+        BlockMasks masks;
+        if (base + 64 <= size) {
+            masks = Classify(data + base);
+        } else {
+            // Pad the last block with whitespace, so it does not produce any entries
+            char block[64];
+            std::memset(block, ' ', sizeof(block));
+            std::memcpy(block, data + base, size - base);
+            masks = Classify(block);
+        }
+
+        const auto escaped = find_escaped(masks.backslash, prev_escaped);
+        const auto quote = masks.quote & ~escaped;
+        // Opening quote up to, but excluding the closing quote
+        const auto in_string = prefix_xor(quote) ^ prev_in_string;
+        prev_in_string = static_cast<uint64_t>(static_cast<int64_t>(in_string) >> 63);
+        const auto opening = quote & in_string;
+        const auto closing = quote & ~in_string;
+        const auto outside = ~(in_string | closing);
+
+        const auto op = masks.op & outside;
+        const auto whitespace = masks.whitespace & outside;
+        const auto scalar = outside & ~op & ~whitespace;
+        const auto boundary = whitespace | op | closing;
+        const auto follows_boundary = boundary << 1 | prev_boundary;
+        prev_boundary = boundary >> 63;
+
+        const auto entries = op | opening | (scalar & follows_boundary);
+        const auto special = (masks.backslash | masks.control) & in_string & ~opening;
+
+        auto bits = entries | closing;
+        if (!special && !string_special) {
+            // Fast path without any strings that need attention
+            auto out = index.size();
+            index.resize(out + __builtin_popcountll(bits));
+            while (bits) {
+                const auto tz = __builtin_ctzll(bits);
+                const auto closing_flag = static_cast<uint32_t>((closing >> tz) & 1) << 31;
+                index[out++] = static_cast<uint32_t>(base + tz) | closing_flag;
+                bits &= bits - 1;
+            }
+            continue;
+        }
+
+        bits |= special;
+        while (bits) {
+            const auto tz = __builtin_ctzll(bits);
+            const auto bit = uint64_t(1) << tz;
+            const auto offset = static_cast<uint32_t>(base + tz);
+            if (special & bit) {
+                string_special = true;
+            } else if (closing & bit) {
+                index.push_back(
+                    offset | index_closing_quote | (string_special ? index_string_special : 0));
+                string_special = false;
+            } else {
+                index.push_back(offset);
+            }
+            bits &= bits - 1;
+        }
+    }
+    index.push_back(static_cast<uint32_t>(size));
+}
+
+
+#if defined(MINIJSON2_SIMD_X86)
+// No lambdas here, because they would not inherit the target attribute
+__attribute__((target("avx2"))) uint64_t movemask_avx2(__m256i v)
+{
+    return static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(v)));
+}
+
+__attribute__((target("avx2"))) __m256i eq_avx2(__m256i v, char ch)
+{
+    return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(ch));
+}
+
+__attribute__((target("avx2"))) BlockMasks classify_block_avx2(const char* block)
+{
+    BlockMasks masks {};
+    for (size_t i = 0; i < 2; ++i) {
+        const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i * 32));
+        const auto shift = i * 32;
+        masks.quote |= movemask_avx2(eq_avx2(v, '"')) << shift;
+        masks.backslash |= movemask_avx2(eq_avx2(v, '\\')) << shift;
+        const auto ws = _mm256_or_si256(_mm256_or_si256(eq_avx2(v, ' '), eq_avx2(v, '\t')),
+            _mm256_or_si256(eq_avx2(v, '\n'), eq_avx2(v, '\r')));
+        masks.whitespace |= movemask_avx2(ws) << shift;
+        // '[' and ']' are '{' and '}' without bit 5 set
+        const auto lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        const auto brackets = _mm256_or_si256(eq_avx2(lower, '{'), eq_avx2(lower, '}'));
+        const auto op
+            = _mm256_or_si256(_mm256_or_si256(eq_avx2(v, ','), eq_avx2(v, ':')), brackets);
+        masks.op |= movemask_avx2(op) << shift;
+        const auto control = _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x1F)), v);
+        masks.control |= movemask_avx2(control) << shift;
+    }
+    return masks;
+}
+
+__attribute__((target("avx2"))) void build_structural_index_avx2(
+    const char* data, size_t size, std::vector<uint32_t>& index)
+{
+    build_structural_index_impl<classify_block_avx2>(data, size, index);
+}
+#endif
+
+#if defined(MINIJSON2_SIMD_X86) || defined(MINIJSON2_SIMD_NEON)
+void build_structural_index_default(const char* data, size_t size, std::vector<uint32_t>& index)
+{
+    build_structural_index_impl<classify_block>(data, size, index);
+}
+#endif
+
+void build_structural_index_scalar(const char* data, size_t size, std::vector<uint32_t>& index)
+{
+    build_structural_index_impl<classify_block_scalar>(data, size, index);
+}
+
+using ScanFunc = size_t (*)(const char* data, size_t size, size_t pos);
+
+// These start out pointing to a resolver, which replaces the pointer with the best implementation
+// on the first call. This way there is no static initialization order problem and no check on
+// every call. They are atomic, because parsers on multiple threads might resolve at the same time
+// (relaxed loads are plain loads anyway).
+size_t find_string_special_resolve(const char* data, size_t size, size_t pos);
+size_t find_string_special_or_non_ascii_resolve(const char* data, size_t size, size_t pos);
+size_t skip_whitespace_resolve(const char* data, size_t size, size_t pos);
+size_t find_quote_or_bracket_resolve(const char* data, size_t size, size_t pos);
+
+using IndexFunc = void (*)(const char* data, size_t size, std::vector<uint32_t>& index);
+void build_structural_index_resolve(const char* data, size_t size, std::vector<uint32_t>& index);
+
+std::atomic<ScanFunc> find_string_special_impl = find_string_special_resolve;
+std::atomic<ScanFunc> find_string_special_or_non_ascii_impl
+    = find_string_special_or_non_ascii_resolve;
+std::atomic<ScanFunc> skip_whitespace_impl = skip_whitespace_resolve;
+std::atomic<ScanFunc> find_quote_or_bracket_impl = find_quote_or_bracket_resolve;
+std::atomic<IndexFunc> build_structural_index_ptr = build_structural_index_resolve;
+
+using minijson2::simd::Level;
+
+struct Kernels {
+    ScanFunc find_string_special;
+    ScanFunc find_string_special_or_non_ascii;
+    ScanFunc skip_whitespace;
+    ScanFunc find_quote_or_bracket;
+    IndexFunc build_structural_index;
+};
+
+std::optional<Kernels> get_kernels(Level level)
+{
+    switch (level) {
+    case Level::Scalar:
+        return Kernels { find_string_special_scalar, find_string_special_or_non_ascii_scalar,
+            skip_whitespace_scalar, find_quote_or_bracket_scalar, build_structural_index_scalar };
+#if defined(MINIJSON2_SIMD_X86)
+    case Level::Sse2:
+        return Kernels { find_string_special_sse2, find_string_special_or_non_ascii_sse2,
+            skip_whitespace_sse2, find_quote_or_bracket_sse2, build_structural_index_default };
+    case Level::Avx2:
+        if (!has_avx2()) {
+            return std::nullopt;
+        }
+        return Kernels { find_string_special_avx2, find_string_special_or_non_ascii_avx2,
+            skip_whitespace_avx2, find_quote_or_bracket_avx2, build_structural_index_avx2 };
+#elif defined(MINIJSON2_SIMD_NEON)
+    case Level::Neon:
+        return Kernels { find_string_special_neon, find_string_special_or_non_ascii_neon,
+            skip_whitespace_neon, find_quote_or_bracket_neon, build_structural_index_default };
+#endif
+    default:
+        return std::nullopt;
+    }
+}
+
+Level get_best_level()
+{
+#if defined(MINIJSON2_SIMD_X86)
+    return has_avx2() ? Level::Avx2 : Level::Sse2;
+#elif defined(MINIJSON2_SIMD_NEON)
+    return Level::Neon;
+#else
+    return Level::Scalar;
+#endif
+}
+
+void store_kernels(const Kernels& kernels)
+{
+    find_string_special_impl.store(kernels.find_string_special, std::memory_order_relaxed);
+    find_string_special_or_non_ascii_impl.store(
+        kernels.find_string_special_or_non_ascii, std::memory_order_relaxed);
+    skip_whitespace_impl.store(kernels.skip_whitespace, std::memory_order_relaxed);
+    find_quote_or_bracket_impl.store(kernels.find_quote_or_bracket, std::memory_order_relaxed);
+    build_structural_index_ptr.store(kernels.build_structural_index, std::memory_order_relaxed);
+}
+
+void resolve()
+{
+    store_kernels(*get_kernels(get_best_level()));
+}
+
+size_t find_string_special_resolve(const char* data, size_t size, size_t pos)
+{
+    resolve();
+    return find_string_special_impl.load(std::memory_order_relaxed)(data, size, pos);
+}
+
+size_t find_string_special_or_non_ascii_resolve(const char* data, size_t size, size_t pos)
+{
+    resolve();
+    return find_string_special_or_non_ascii_impl.load(std::memory_order_relaxed)(data, size, pos);
+}
+
+size_t skip_whitespace_resolve(const char* data, size_t size, size_t pos)
+{
+    resolve();
+    return skip_whitespace_impl.load(std::memory_order_relaxed)(data, size, pos);
+}
+
+size_t find_quote_or_bracket_resolve(const char* data, size_t size, size_t pos)
+{
+    resolve();
+    return find_quote_or_bracket_impl.load(std::memory_order_relaxed)(data, size, pos);
+}
+
+void build_structural_index_resolve(const char* data, size_t size, std::vector<uint32_t>& index)
+{
+    resolve();
+    build_structural_index_ptr.load(std::memory_order_relaxed)(data, size, index);
+}
+}
+
+namespace minijson2::simd {
+
+Level best_level()
+{
+    return get_best_level();
+}
+
+bool is_level_supported(Level level)
+{
+    return get_kernels(level).has_value();
+}
+
+bool use_level(Level level)
+{
+    const auto kernels = get_kernels(level);
+    if (!kernels) {
+        return false;
+    }
+    store_kernels(*kernels);
+    return true;
+}
+
+size_t find_string_special(const char* data, size_t size, size_t pos)
+{
+    return find_string_special_impl.load(std::memory_order_relaxed)(data, size, pos);
+}
+
+size_t find_string_special_or_non_ascii(const char* data, size_t size, size_t pos)
+{
+    return find_string_special_or_non_ascii_impl.load(std::memory_order_relaxed)(data, size, pos);
+}
+
+size_t skip_whitespace(const char* data, size_t size, size_t pos)
+{
+    // Whitespace runs are usually short (or absent in minified documents), so check the first
+    // character before paying for the call through the pointer.
+    if (pos >= size || !is_whitespace(data[pos])) {
+        return pos;
+    }
+    return skip_whitespace_impl.load(std::memory_order_relaxed)(data, size, pos + 1);
+}
+
+size_t find_quote_or_bracket(const char* data, size_t size, size_t pos)
+{
+    return find_quote_or_bracket_impl.load(std::memory_order_relaxed)(data, size, pos);
+}
+
+void build_structural_index(const char* data, size_t size, std::vector<uint32_t>& index)
+{
+    build_structural_index_ptr.load(std::memory_order_relaxed)(data, size, index);
+}
+
+}
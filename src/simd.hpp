@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Internal scanning kernels. These are vectorized (SSE2/AVX2 on x86-64, NEON on aarch64) and the
+// best implementation available on the current CPU is picked on first use.
+namespace minijson2::simd {
+
+// The sets of kernel implementations. Scalar is always available, the others depend on the target
+// and the CPU.
+enum class Level : uint8_t {
+    Scalar,
+    Sse2,
+    Avx2,
+    Neon,
+};
+
+// The level that is used, unless use_level is called
+Level best_level();
+
+bool is_level_supported(Level level);
+
+// Switches all kernels to the given level, e.g. to compare the implementations with each other.
+// Returns false (and changes nothing) if the level is not supported. Parsers on other threads might
+// see a mix of both levels for a moment, which is harmless, because all of them give the same
+// results.
+bool use_level(Level level);
+
+// Returns the index of the first character at or after pos that is either '"', '\\' or a control
+// character (< 0x20), i.e. everything that needs attention inside a string. Returns size if there
+// is none.
+size_t find_string_special(const char* data, size_t size, size_t pos);
+
+// find_string_special, which also stops at non-ASCII bytes (>= 0x80), for UTF-8 validation
+size_t find_string_special_or_non_ascii(const char* data, size_t size, size_t pos);
+
+// Returns the index of the first character at or after pos that is not JSON whitespace (space,
+// tab, line feed or carriage return). Returns size if there is none.
+size_t skip_whitespace(const char* data, size_t size, size_t pos);
+
+// Returns the index of the first '"', '[', ']', '{' or '}' at or after pos or size if there is none
+size_t find_quote_or_bracket(const char* data, size_t size, size_t pos);
+
+// The structural index contains the offset of every token start (structural characters, opening
+// quotes and the first character of scalars) and of every closing quote. The upper bits are used
+// as flags, so it can only be built for inputs smaller than max_indexed_size.
+constexpr uint32_t index_offset_mask = 0x3FFF'FFFF;
+constexpr uint32_t index_closing_quote = 0x8000'0000;
+// Set on closing quotes if the string contains a backslash or a control character, i.e. if it
+// needs to be looked at more closely.
+constexpr uint32_t index_string_special = 0x4000'0000;
+constexpr size_t max_indexed_size = index_offset_mask;
+
+// Stage 1 of the indexed parse mode. Builds the structural index of the whole input, terminated by
+// an entry containing size.
+void build_structural_index(const char* data, size_t size, std::vector<uint32_t>& index);
+
+}
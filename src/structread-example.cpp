@@ -1,6 +1,7 @@
 #include <iostream>
 
 #include <minijson2/minijson2.hpp>
+#include <minijson2/writer.hpp>
 
 using namespace minijson2;
 
@@ -100,4 +101,9 @@ int main()
     }
 
     print(gltf);
+
+    // And back again
+    Writer writer({ .pretty = true });
+    structwrite::to_json(gltf, writer);
+    std::cout << writer.output() << std::endl;
 }
\ No newline at end of file
@@ -0,0 +1,206 @@
+#include "minijson2/writer.hpp"
+
+#include <cassert>
+#include <charconv>
+#include <cmath>
+
+#include "simd.hpp"
+
+namespace minijson2 {
+
+Writer::Writer(WriteOptions options) : options_(options) { }
+
+void Writer::begin_object()
+{
+    separate();
+    buffer_.push_back('{');
+    depth_++;
+    first_ = true;
+}
+
+void Writer::end_object()
+{
+    assert(depth_ > 0 && !after_key_);
+    depth_--;
+    if (!first_) {
+        newline();
+    }
+    buffer_.push_back('}');
+    first_ = false;
+}
+
+void Writer::begin_array()
+{
+    separate();
+    buffer_.push_back('[');
+    depth_++;
+    first_ = true;
+}
+
+void Writer::end_array()
+{
+    assert(depth_ > 0 && !after_key_);
+    depth_--;
+    if (!first_) {
+        newline();
+    }
+    buffer_.push_back(']');
+    first_ = false;
+}
+
+void Writer::key(std::string_view key)
+{
+    assert(depth_ > 0 && !after_key_);
+    separate();
+    write_string(key);
+    if (options_.pretty) {
+        buffer_.append(": ");
+    } else {
+        buffer_.push_back(':');
+    }
+    after_key_ = true;
+}
+
+void Writer::null()
+{
+    separate();
+    buffer_.append("null");
+}
+
+void Writer::value(bool v)
+{
+    separate();
+    buffer_.append(v ? "true" : "false");
+}
+
+void Writer::value(int64_t v)
+{
+    separate();
+    char buf[24];
+    const auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    buffer_.append(buf, res.ptr);
+}
+
+void Writer::value(uint64_t v)
+{
+    separate();
+    char buf[24];
+    const auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    buffer_.append(buf, res.ptr);
+}
+
+void Writer::value(double v)
+{
+    if (!std::isfinite(v)) {
+        null();
+        return;
+    }
+    separate();
+    // The shortest representation that parses back to the same value
+    char buf[32];
+    const auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    buffer_.append(buf, res.ptr);
+}
+
+void Writer::value(std::string_view str)
+{
+    separate();
+    write_string(str);
+}
+
+void Writer::raw_value(std::string_view json)
+{
+    separate();
+    buffer_.append(json);
+}
+
+std::string_view Writer::output() const
+{
+    return buffer_;
+}
+
+void Writer::clear()
+{
+    buffer_.clear();
+    depth_ = 0;
+    first_ = true;
+    after_key_ = false;
+}
+
+void Writer::separate()
+{
+    if (after_key_) {
+        after_key_ = false;
+        return;
+    }
+    if (depth_ == 0) {
+        // Multiple documents are separated by newlines, like NDJSON
+        if (!buffer_.empty()) {
+            buffer_.push_back('\n');
+        }
+        return;
+    }
+    if (!first_) {
+        buffer_.push_back(',');
+    }
+    first_ = false;
+    newline();
+}
+
+void Writer::newline()
+{
+    if (options_.pretty) {
+        buffer_.push_back('\n');
+        buffer_.append(depth_ * options_.indent, ' ');
+    }
+}
+
+void Writer::write_string(std::string_view str)
+{
+    buffer_.push_back('"');
+    // Most strings need no escaping at all, so copy everything up to the next special character
+    // in one go
+    size_t pos = 0;
+    while (true) {
+        const auto special = simd::find_string_special(str.data(), str.size(), pos);
+        buffer_.append(str.data() + pos, special - pos);
+        if (special >= str.size()) {
+            break;
+        }
+        const auto ch = str[special];
+        switch (ch) {
+        case '"':
+            buffer_.append("\\\"");
+            break;
+        case '\\':
+            buffer_.append("\\\\");
+            break;
+        case '\b':
+            buffer_.append("\\b");
+            break;
+        case '\f':
+            buffer_.append("\\f");
+            break;
+        case '\n':
+            buffer_.append("\\n");
+            break;
+        case '\r':
+            buffer_.append("\\r");
+            break;
+        case '\t':
+            buffer_.append("\\t");
+            break;
+        default: {
+            constexpr auto hex = "0123456789abcdef";
+            const auto c = static_cast<unsigned char>(ch);
+            const char escape[] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+            buffer_.append(escape, sizeof(escape));
+            break;
+        }
+        }
+        pos = special + 1;
+    }
+    buffer_.push_back('"');
+}
+
+}